@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include "buddy.h"
+#include "frame.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Zone bookkeeping. Indices are relative to zone_base; each free block
+// is linked into the list of its order through its first frame.
+//======================================================================
+static int  zone_base;                       // First PFN of the zone
+static int  zone_frames;                     // Frames in the zone
+static int  zone_free;                       // Free frames in the zone
+static int *block_order;                     // Order of a free block head, -1 otherwise
+static int *next_block;                      // Free-list links
+static int *prev_block;
+static int  free_head[BUDDY_MAX_ORDER + 1];  // First free block of each order
+
+//======================================================================
+// Free-list helpers
+//======================================================================
+static void push_block(int idx, int order) {
+    block_order[idx] = order;
+    prev_block[idx]  = -1;
+    next_block[idx]  = free_head[order];
+    if (free_head[order] >= 0) {
+        prev_block[free_head[order]] = idx;
+    }
+    free_head[order] = idx;
+}
+
+static void remove_block(int idx) {
+    int order = block_order[idx];
+    if (prev_block[idx] >= 0) {
+        next_block[prev_block[idx]] = next_block[idx];
+    } else {
+        free_head[order] = next_block[idx];
+    }
+    if (next_block[idx] >= 0) {
+        prev_block[next_block[idx]] = prev_block[idx];
+    }
+    block_order[idx] = -1;
+}
+
+//======================================================================
+// Take the maximal block at idx off the frame stack if all its frames
+// are free there
+// Returns 1 if the block joined the zone, 0 otherwise
+//======================================================================
+static int take_block(int idx) {
+    const int block = 1 << BUDDY_MAX_ORDER;
+
+    for (int i = 0; i < block; i++) {
+        if (!frame_is_free(zone_base + idx + i)) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < block; i++) {
+        get_frame_number(zone_base + idx + i);
+        frame_tag(zone_base + idx + i, FRAME_OWNER_KERNEL, FRAME_BUDDY_FREE);
+        frame_set_flags(zone_base + idx + i, FRAME_F_BUDDY);
+    }
+    push_block(idx, BUDDY_MAX_ORDER);
+    zone_free += block;
+    return 1;
+}
+
+//======================================================================
+// Carve the zone out of the top of physical memory. Only maximal blocks
+// whose frames are all still free are taken off the frame stack.
+//======================================================================
+void buddy_init(void) {
+    const int block = 1 << BUDDY_MAX_ORDER;
+
+    zone_frames = (frames_total() / BUDDY_ZONE_SHARE) & ~(block - 1);
+    zone_base   = (frames_total() - zone_frames) & ~(block - 1);
+    zone_free   = 0;
+
+    for (int o = 0; o <= BUDDY_MAX_ORDER; o++) {
+        free_head[o] = -1;
+    }
+    if (zone_frames == 0) {
+        return;
+    }
+
+    block_order = malloc(zone_frames * sizeof(int));
+    next_block  = malloc(zone_frames * sizeof(int));
+    prev_block  = malloc(zone_frames * sizeof(int));
+    if (block_order == NULL || next_block == NULL || prev_block == NULL) {
+        TracePrintf(0, "buddy_init: failed to allocate zone tables\n");
+        Halt();
+    }
+
+    for (int i = 0; i < zone_frames; i++) {
+        block_order[i] = -1;
+    }
+
+    for (int idx = 0; idx < zone_frames; idx += block) {
+        take_block(idx);
+    }
+
+    TracePrintf(1, "buddy_init: zone at frame %d, %d of %d frames free\n",
+                zone_base, zone_free, zone_frames);
+}
+
+//======================================================================
+// Lend free zone frames back to the frame stack when memory runs short,
+// smallest blocks first so whole kernel-stack runs last longest. A lent
+// frame leaves the zone until buddy_refill() takes its block back.
+// Returns: the number of frames lent
+//======================================================================
+int buddy_lend(int nframes) {
+    int lent = 0;
+
+    for (int o = 0; o <= BUDDY_MAX_ORDER && lent < nframes; o++) {
+        while (free_head[o] >= 0 && lent < nframes) {
+            int idx = free_head[o];
+            remove_block(idx);
+            for (int i = 0; i < (1 << o); i++) {
+                frame_clear_flags(zone_base + idx + i, FRAME_F_BUDDY);
+                free_frame_number(zone_base + idx + i);
+            }
+            zone_free -= 1 << o;
+            lent += 1 << o;
+        }
+    }
+    if (lent > 0) {
+        TracePrintf(1, "buddy_lend: %d frames back to the frame stack\n", lent);
+    }
+    return lent;
+}
+
+//======================================================================
+// Take back up to nblocks lent blocks whose frames are all free again,
+// as long as the frames to spare stay above the low watermark
+// Returns: the number of blocks taken back
+//======================================================================
+int buddy_refill(int nblocks) {
+    const int block = 1 << BUDDY_MAX_ORDER;
+    int taken = 0;
+
+    for (int idx = 0; idx < zone_frames && taken < nblocks; idx += block) {
+        if (frames_available(FRAME_CLASS_PROCESS) < block) {
+            break;
+        }
+        taken += take_block(idx);
+    }
+    return taken;
+}
+
+//======================================================================
+// Smallest order whose run covers npages frames, or ERROR if too big
+//======================================================================
+int buddy_order(int npages) {
+    for (int o = 0; o <= BUDDY_MAX_ORDER; o++) {
+        if ((1 << o) >= npages) {
+            return o;
+        }
+    }
+    return ERROR;
+}
+
+//======================================================================
+// Allocate 1 << order contiguous frames, splitting a larger block if needed
+// Returns: first PFN of the run, or ERROR if the zone can't satisfy it
+//======================================================================
+int buddy_alloc(int order) {
+
+    if (order < 0 || order > BUDDY_MAX_ORDER) {
+        return ERROR;
+    }
+
+    int o = order;
+    while (o <= BUDDY_MAX_ORDER && free_head[o] < 0) {
+        o++;
+    }
+    if (o > BUDDY_MAX_ORDER) {
+        return ERROR;
+    }
+
+    int idx = free_head[o];
+    remove_block(idx);
+
+    // Split down, returning the upper halves to their free lists
+    while (o > order) {
+        o--;
+        push_block(idx + (1 << o), o);
+    }
+
+    zone_free -= 1 << order;
+    return zone_base + idx;
+}
+
+//======================================================================
+// Return a run from buddy_alloc, coalescing with free buddies
+//======================================================================
+void buddy_free(int pfn, int order) {
+
+    if (!buddy_owns(pfn) || order < 0 || order > BUDDY_MAX_ORDER) {
+        TracePrintf(0, "buddy_free: frame %d order %d not from the zone\n", pfn, order);
+        return;
+    }
+
+    int idx = pfn - zone_base;
+    zone_free += 1 << order;
+
+    while (order < BUDDY_MAX_ORDER) {
+        int buddy = idx ^ (1 << order);
+        if (buddy >= zone_frames || block_order[buddy] != order) {
+            break;
+        }
+        remove_block(buddy);
+        if (buddy < idx) {
+            idx = buddy;
+        }
+        order++;
+    }
+    push_block(idx, order);
+}
+
+//======================================================================
+// Query helpers
+//======================================================================
+int buddy_owns(int pfn) {
+    if (pfn < zone_base || pfn >= zone_base + zone_frames) {
+        return 0;
+    }
+    // Blocks that weren't free at boot stay on the frame stack
+    return (frame_desc(pfn)->flags & FRAME_F_BUDDY) != 0;
+}
+
+int buddy_free_frames(void) {
+    return zone_free;
+}
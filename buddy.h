@@ -0,0 +1,27 @@
+/* buddy.h - Buddy allocator for physically contiguous frame runs */
+
+#ifndef _BUDDY_H
+#define _BUDDY_H
+
+#include "hardware.h"
+#include "yalnix.h"
+
+//==========================================================================
+// Largest run handed out is 1 << BUDDY_MAX_ORDER frames. The zone is carved
+// out of the top of physical memory at boot, 1/BUDDY_ZONE_SHARE of it.
+// Its free frames are lent back to the frame stack under memory pressure,
+// and idle ticks take whole free blocks back, one per tick.
+//==========================================================================
+#define BUDDY_MAX_ORDER   4
+#define BUDDY_ZONE_SHARE  16
+
+void buddy_init(void);
+int  buddy_order(int npages);
+int  buddy_alloc(int order);
+void buddy_free(int pfn, int order);
+int  buddy_owns(int pfn);
+int  buddy_free_frames(void);
+int  buddy_lend(int nframes);
+int  buddy_refill(int nblocks);
+
+#endif /* _BUDDY_H */
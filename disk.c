@@ -0,0 +1,119 @@
+#include <string.h>
+#include "disk.h"
+#include "frame.h"
+#include "process.h"
+#include "queue.h"
+#include "kernel.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Device state: the process whose transfer holds the disk, those waiting
+// for it, and whether the sector last started has completed
+//======================================================================
+static PCB     *disk_owner   = NULL;
+static queue_t *disk_waiters = NULL;
+static int      disk_done    = 1;
+static char     bounce[SECTORSIZE];
+
+//======================================================================
+// Block the current process and run the next ready one until someone
+// puts it back on the ready queue
+//======================================================================
+static void disk_sleep(void) {
+    currentPCB->state = PCB_BLOCKED;
+
+    PCB *next = queue_get(ready_processes);
+    if (next == NULL) {
+        next = idlePCB;
+    }
+    KernelContextSwitch(KCSwitch, currentPCB, next);
+}
+
+static void disk_wake(PCB *pcb) {
+    if (pcb != NULL && pcb->state == PCB_BLOCKED) {
+        pcb->state = PCB_READY;
+        queue_add(ready_processes, pcb);
+    }
+}
+
+//======================================================================
+// Take the disk for the current process, waiting behind earlier
+// transfers; disk_release hands it straight to the next waiter
+//======================================================================
+static int disk_acquire(void) {
+    if (disk_waiters == NULL && (disk_waiters = queue_new()) == NULL) {
+        return ERROR;
+    }
+    if (disk_owner == NULL) {
+        disk_owner = currentPCB;
+        return 0;
+    }
+    queue_add(disk_waiters, currentPCB);
+    while (disk_owner != currentPCB) {
+        disk_sleep();
+    }
+    return 0;
+}
+
+static void disk_release(void) {
+    disk_owner = queue_get(disk_waiters);
+    disk_wake(disk_owner);
+}
+
+//======================================================================
+// Move nbytes between frame pfn and the disk, from sector onward, and
+// sleep until the last sector is done. The frame stays allocated and
+// untouched by anyone else for the whole transfer; that is the caller's
+// to ensure.
+// Returns 0, or ERROR if the current process can't sleep (idle or boot)
+//======================================================================
+int disk_frame_io(int op, int sector, int nbytes, int pfn) {
+
+    if (currentPCB == NULL || currentPCB == idlePCB) {
+        TracePrintf(0, "disk_frame_io: no process to block for sector %d\n", sector);
+        return ERROR;
+    }
+    if (disk_acquire() < 0) {
+        return ERROR;
+    }
+
+    for (int done = 0; done < nbytes; done += SECTORSIZE, sector++) {
+        int len = (nbytes - done < SECTORSIZE) ? nbytes - done : SECTORSIZE;
+        char *page;
+
+        if (op == DISK_WRITE) {
+            page = frame_map_temp(pfn);
+            memcpy(bounce, page + done, len);
+            frame_unmap_temp(page);
+        }
+
+        disk_done = 0;
+        DiskAccess(op, sector, bounce);
+        while (!disk_done) {
+            disk_sleep();
+        }
+
+        if (op == DISK_READ) {
+            page = frame_map_temp(pfn);
+            memcpy(page + done, bounce, len);
+            frame_unmap_temp(page);
+        }
+    }
+
+    disk_release();
+    return 0;
+}
+
+//======================================================================
+// TRAP_DISK: the sector last started is done; let its owner go on
+//======================================================================
+void disk_interrupt(void) {
+    if (disk_done) {
+        TracePrintf(0, "disk_interrupt: no transfer in progress\n");
+        return;
+    }
+    disk_done = 1;
+    disk_wake(disk_owner);
+}
@@ -0,0 +1,20 @@
+/* disk.h - Blocking sector transfers between the DISK device and frames */
+
+#ifndef _DISK_H
+#define _DISK_H
+
+#include "hardware.h"
+#include "yalnix.h"
+
+//==========================================================================
+// The device does one sector at a time and signals TRAP_DISK when it is
+// done. A transfer owns the device from its first sector to its last;
+// the process asking for it sleeps through each sector, and others that
+// want the disk meanwhile wait their turn in arrival order. Sectors move
+// through a kernel bounce buffer, so the frame need not be mapped while
+// its owner sleeps.
+//==========================================================================
+int  disk_frame_io(int op, int sector, int nbytes, int pfn);
+void disk_interrupt(void);
+
+#endif /* _DISK_H */
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include "diskmap.h"
+#include "disk.h"
+#include "process.h"
+#include "queue.h"
+#include "frame.h"
+#include "tlb.h"
+#include "vm.h"
+#include "kernel.h"
+
+//=====================================================================
+// Define the mapping record
+//=====================================================================
+typedef struct dmap {
+    PCB* pcb;
+    int base;               // first region 1 page of the mapping
+    int npages;
+} dmap_t;
+
+static queue_t* dmap_queue = NULL;
+
+//=====================================================================
+// Define lookup callbacks
+//=====================================================================
+static void find_dmap_cb(void *item, void *ctx, void *ctx2) {
+    dmap_t *m = (dmap_t *)item;
+    dmap_t *key = (dmap_t *)ctx;
+    dmap_t **out_ptr = (dmap_t **)ctx2;
+
+    if (m->pcb == key->pcb && (key->base < 0 || m->base == key->base) && *out_ptr == NULL) {
+        *out_ptr = m;
+    }
+}
+
+static dmap_t* find_dmap(PCB* pcb, int base) {
+    dmap_t key = { pcb, base, 0 };
+    dmap_t* found = NULL;
+    if (dmap_queue != NULL) {
+        queue_iterate(dmap_queue, find_dmap_cb, &key, &found);
+    }
+    return found;
+}
+
+//=====================================================================
+// Define DiskMapRead function
+//      Read nbytes from byte offset onward into frame pfn; the caller
+//      sleeps until the read is done
+//      Returns 0, or ERROR if the caller can't wait for the disk
+//=====================================================================
+int DiskMapRead(unsigned int offset, int nbytes, int pfn) {
+    return disk_frame_io(DISK_READ, offset / SECTORSIZE, nbytes, pfn);
+}
+
+//=====================================================================
+// Write back the dirty pages of m, unmap it and free the record. Each
+// page is unmapped before its write starts and its frame freed once the
+// write is done; m->pcb is the current process, which sleeps meanwhile.
+//=====================================================================
+static void unmap(dmap_t* m) {
+    PCB* pcb = m->pcb;
+
+    for (int vpn = m->base; vpn < m->base + m->npages; vpn++) {
+        pte_t* pte = &pcb->region1_pt[vpn];
+        vpage_t* vp = &pcb->vpages[vpn];
+        if (!pte->valid) {
+            continue;
+        }
+        pte->valid = 0;
+        if (pcb == currentPCB) {
+            tlb_flush_page(VMEM_1_BASE + (vpn << PAGESHIFT), TLB_R_UNMAP);
+        }
+        if ((vp->flags & VPG_DIRTY) &&
+            disk_frame_io(DISK_WRITE, vp->offset / SECTORSIZE, vp->nbytes, pte->pfn) < 0) {
+            TracePrintf(0, "DiskUnmap: page %d of process %d lost its writes\n", vpn, pcb->pid);
+        }
+        free_frame_number(pte->pfn);
+    }
+    vm_clear_range(pcb, m->base, m->base + m->npages);
+
+    queue_delete_node(dmap_queue, m);
+    free(m);
+}
+
+//=====================================================================
+// Define DiskMap function
+//      Map nsectors sectors from sector onward into the caller; nothing
+//      is read until a page is touched
+//      Returns the address of the mapping, or ERROR
+//=====================================================================
+int DiskMap(int sector, int nsectors) {
+
+    if (sector < 0 || nsectors <= 0 || nsectors > DISKMAP_LAST_SECTOR - sector) {
+        TracePrintf(0, "DiskMap: sectors %d+%d outside the mappable disk\n", sector, nsectors);
+        return ERROR;
+    }
+    int nbytes = nsectors * SECTORSIZE;
+    int npages = (nbytes + PAGESIZE - 1) / PAGESIZE;
+    if (npages > DISKMAP_MAX_PAGES) {
+        TracePrintf(0, "DiskMap: %d pages is too large\n", npages);
+        return ERROR;
+    }
+    if (dmap_queue == NULL && (dmap_queue = queue_new()) == NULL) {
+        return ERROR;
+    }
+
+    int base = vm_find_gap(currentPCB, npages, DISKMAP_STACK_GAP);
+    if (base < 0) {
+        TracePrintf(0, "DiskMap: no room for %d pages in process %d\n", npages, currentPCB->pid);
+        return ERROR;
+    }
+
+    dmap_t* m = malloc(sizeof(dmap_t));
+    if (m == NULL) {
+        return ERROR;
+    }
+    m->pcb = currentPCB;
+    m->base = base;
+    m->npages = npages;
+
+    vm_set_backing(currentPCB, base, base + npages, VPG_DISK, PROT_READ | PROT_WRITE,
+                   FRAME_USER_DISK, sector * SECTORSIZE, nbytes);
+    for (int vpn = base; vpn < base + npages; vpn++) {
+        currentPCB->vpages[vpn].flags |= VPG_DMAP;
+    }
+    queue_add(dmap_queue, m);
+
+    TracePrintf(1, "DiskMap: sectors %d+%d at page %d of process %d\n",
+                sector, nsectors, base, currentPCB->pid);
+    return VMEM_1_BASE + (base << PAGESHIFT);
+}
+
+//=====================================================================
+// Define DiskUnmap function
+//      addr is what DiskMap returned
+//      Returns 0, or ERROR if there is no mapping at addr
+//=====================================================================
+int DiskUnmap(void *addr) {
+
+    unsigned int a = (unsigned int)addr;
+    if (a < VMEM_1_BASE || a >= VMEM_1_LIMIT || (a & PAGEOFFSET) != 0) {
+        return ERROR;
+    }
+    dmap_t* m = find_dmap(currentPCB, (a - VMEM_1_BASE) >> PAGESHIFT);
+    if (m == NULL) {
+        TracePrintf(0, "DiskUnmap: no mapping at %p in process %d\n", addr, currentPCB->pid);
+        return ERROR;
+    }
+    unmap(m);
+    return 0;
+}
+
+//=====================================================================
+// Define DiskUnmapAll function
+//      Write back and unmap every mapping of pcb, at Exec and Exit
+//=====================================================================
+void DiskUnmapAll(PCB *pcb) {
+    dmap_t* m;
+    while ((m = find_dmap(pcb, -1)) != NULL) {
+        unmap(m);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef DISKMAP_H
+#define DISKMAP_H
+
+#include "process.h"
+#include "swap.h"
+
+//=====================================================================
+// Disk mappings: a sector range of the DISK device mapped into region 1.
+// Pages are read on first touch and start clean; the first write marks
+// a page dirty, and dirty pages are written back on DiskUnmap, Exec and
+// Exit. Mappings are private to a process: Fork gives the child a copy,
+// and two mappings of the same sectors see each other's writes only
+// after write-back. The swap area at the end of the disk can't be mapped.
+//=====================================================================
+#define DISKMAP_MAX_PAGES    32                  // largest mapping
+#define DISKMAP_LAST_SECTOR  SWAP_FIRST_SECTOR   // first sector past the mappable area
+#define DISKMAP_STACK_GAP    8                   // pages left below the stack for it to grow
+
+int DiskMap(int sector, int nsectors);
+int DiskUnmap(void *addr);
+void DiskUnmapAll(PCB *pcb);
+int DiskMapRead(unsigned int offset, int nbytes, int pfn);
+
+#endif // DISKMAP_H
@@ -0,0 +1,490 @@
+#include <stdlib.h>
+#include <string.h>
+#include "frame.h"
+#include "kernel.h"
+#include "tlb.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Physical frame bookkeeping
+//======================================================================
+static int  num_frames;      // Number of physical frames
+static int  num_free;        // Number of frames currently on the stack
+static int *free_stack;      // Free PFNs, top of stack at num_free - 1
+static int *stack_slot;      // Slot of each frame in free_stack, -1 if in use
+static int *zero_stack;      // Free frames already cleared during idle time
+static int  num_zeroed;      // Number of frames on zero_stack
+static frame_desc_t *frame_table;  // One descriptor per physical frame
+static int  frame_min;       // Free frames user allocations may not take
+static int  frame_low;       // Free frames a new process may not take
+
+//======================================================================
+// Give a frame its first reference, owned by the kernel until tagged
+//======================================================================
+static void claim_frame(int pfn) {
+    frame_table[pfn].refcount = 1;
+    frame_table[pfn].owner    = FRAME_OWNER_KERNEL;
+    frame_table[pfn].use      = FRAME_UNTAGGED;
+    frame_table[pfn].flags    = 0;
+}
+
+//======================================================================
+// Build the free-frame stack for pmem_size bytes of physical memory.
+// Frames are pushed high to low so that frame 0 is handed out first.
+//======================================================================
+void frame_init(unsigned int pmem_size) {
+
+    num_frames = (int)(pmem_size >> PAGESHIFT);
+    free_stack = malloc(num_frames * sizeof(int));
+    stack_slot = malloc(num_frames * sizeof(int));
+    zero_stack = malloc(ZERO_POOL_TARGET * sizeof(int));
+    frame_table = calloc(num_frames, sizeof(frame_desc_t));
+    if (free_stack == NULL || stack_slot == NULL || zero_stack == NULL || frame_table == NULL) {
+        TracePrintf(0, "frame_init: failed to allocate frame tables\n");
+        Halt();
+    }
+
+    num_free = 0;
+    num_zeroed = 0;
+    frame_set_watermarks(FRAME_MIN_RESERVE + num_frames / 64, FRAME_LOW_RESERVE + num_frames / 32);
+    for (int pfn = num_frames - 1; pfn >= 0; pfn--) {
+        frame_table[pfn].owner = FRAME_OWNER_NONE;
+        frame_table[pfn].use   = FRAME_FREE;
+        stack_slot[pfn] = num_free;
+        free_stack[num_free++] = pfn;
+    }
+}
+
+//======================================================================
+// Find and allocate a free physical frame
+// Returns: frame index or ERROR if none available
+//======================================================================
+int get_free_frame(void) {
+
+    int pfn;
+
+    if (num_free > 0) {
+        pfn = free_stack[--num_free];
+        stack_slot[pfn] = -1;
+    } else if (num_zeroed > 0) {
+        pfn = zero_stack[--num_zeroed];
+    } else {
+        return ERROR;
+    }
+
+    claim_frame(pfn);
+    return pfn;
+}
+
+//======================================================================
+// Mark a specific frame as used (boot-time identity mappings)
+// The top of the stack moves into the vacated slot; a frame on the zero
+// pool is taken off it instead.
+// Returns: index, or ERROR if the frame is out of range or not free
+//======================================================================
+int get_frame_number(int index) {
+
+    if (index < 0 || index >= num_frames) {
+        TracePrintf(0, "get_frame_number: frame %d out of range\n", index);
+        return ERROR;
+    }
+    if (stack_slot[index] < 0) {
+        for (int i = 0; i < num_zeroed; i++) {
+            if (zero_stack[i] == index) {
+                zero_stack[i] = zero_stack[--num_zeroed];
+                claim_frame(index);
+                return index;
+            }
+        }
+        TracePrintf(0, "get_frame_number: frame %d is not free\n", index);
+        return ERROR;
+    }
+
+    int slot = stack_slot[index];
+    int top  = free_stack[--num_free];
+    free_stack[slot] = top;
+    stack_slot[top]  = slot;
+    stack_slot[index] = -1;
+    claim_frame(index);
+    return index;
+}
+
+//======================================================================
+// Drop one reference to a frame; the last one returns it to the stack
+//======================================================================
+void free_frame_number(int index) {
+
+    if (index < 0 || index >= num_frames) {
+        TracePrintf(0, "free_frame_number: frame %d out of range\n", index);
+        return;
+    }
+    if (frame_table[index].refcount == 0) {
+        TracePrintf(0, "free_frame_number: frame %d is already free\n", index);
+        return;
+    }
+    if (--frame_table[index].refcount > 0) {
+        return;
+    }
+
+    frame_table[index].owner = FRAME_OWNER_NONE;
+    frame_table[index].use   = FRAME_FREE;
+    frame_table[index].flags = 0;
+    stack_slot[index] = num_free;
+    free_stack[num_free++] = index;
+}
+
+//======================================================================
+// Query helpers
+//======================================================================
+int frame_is_free(int index) {
+    return index >= 0 && index < num_frames && stack_slot[index] >= 0;
+}
+
+int frames_free(void) {
+    return num_free + num_zeroed;
+}
+
+int frames_total(void) {
+    return num_frames;
+}
+
+//======================================================================
+// Set the min and low watermarks; low may not be below min
+// Returns 0 on success, ERROR on bad values
+//======================================================================
+int frame_set_watermarks(int min, int low) {
+
+    if (min < 0 || low < min || low > num_frames) {
+        return ERROR;
+    }
+    frame_min = min;
+    frame_low = low;
+    TracePrintf(1, "frame watermarks: min %d, low %d of %d frames\n", min, low, num_frames);
+    return 0;
+}
+
+//======================================================================
+// Number of frames an allocation of the given class may still take
+//======================================================================
+int frames_available(frame_class_t cls) {
+    int avail = frames_free();
+
+    if (cls == FRAME_CLASS_USER) {
+        avail -= frame_min;
+    } else if (cls == FRAME_CLASS_PROCESS) {
+        avail -= frame_low;
+    }
+    return avail > 0 ? avail : 0;
+}
+
+//======================================================================
+// Batched allocation: reserve n frames into frames[], all or nothing
+// Returns 0 on success, ERROR (nothing allocated) if n frames aren't free
+//======================================================================
+int alloc_frames(int n, int *frames) {
+
+    if (n < 0 || n > frames_free()) {
+        return ERROR;
+    }
+
+    for (int i = 0; i < n; i++) {
+        frames[i] = get_free_frame();
+    }
+    return 0;
+}
+
+//======================================================================
+// Return n frames from frames[] to the stack
+//======================================================================
+void free_frames(int *frames, int n) {
+    for (int i = 0; i < n; i++) {
+        free_frame_number(frames[i]);
+    }
+}
+
+//======================================================================
+// Map pages [first, last) of pt to fresh frames with the given protection
+// Either every page is mapped or none is; returns 0 or ERROR
+//======================================================================
+int map_pt_range(pte_t *pt, int first, int last, int prot) {
+
+    if (last - first > frames_available(FRAME_CLASS_USER)) {
+        return ERROR;
+    }
+
+    for (int vpn = first; vpn < last; vpn++) {
+        pt[vpn].valid = 1;
+        pt[vpn].prot  = prot;
+        pt[vpn].pfn   = get_free_frame();
+    }
+    return 0;
+}
+
+//======================================================================
+// Free every valid page in [first, last) of pt in one pass
+// The caller flushes the TLB if pt is live.
+//======================================================================
+void free_pt_range(pte_t *pt, int first, int last) {
+    for (int vpn = first; vpn < last; vpn++) {
+        if (pt[vpn].valid) {
+            free_frame_number(pt[vpn].pfn);
+            pt[vpn].valid = 0;
+        }
+    }
+}
+
+//======================================================================
+// Kernel mapping window. A free slot has no TLB entry; a stale slot is
+// unmapped but may still have one, for the frame it last held.
+//======================================================================
+#define KMAP_FREE    0
+#define KMAP_MAPPED  1
+#define KMAP_STALE   2
+
+static unsigned char kmap_state[KMAP_SLOTS];
+
+//======================================================================
+// Map a frame in a window slot so the kernel can reach its contents
+// Returns: the slot's address; halts if every slot is mapped
+//======================================================================
+void *frame_map_temp(int pfn) {
+    int slot = -1;
+
+    // A stale slot that last held this frame translates correctly already
+    for (int s = 0; s < KMAP_SLOTS; s++) {
+        if (kmap_state[s] == KMAP_STALE && kernel_page_table[KMAP_BASE_VPN + s].pfn == pfn) {
+            slot = s;
+            break;
+        }
+    }
+    for (int pass = 0; slot < 0 && pass < 2; pass++) {
+        if (pass == 1) {
+            frame_temp_flush();
+        }
+        for (int s = 0; s < KMAP_SLOTS; s++) {
+            if (kmap_state[s] == KMAP_FREE) {
+                slot = s;
+                break;
+            }
+        }
+    }
+    if (slot < 0) {
+        TracePrintf(0, "frame_map_temp: all %d window slots are mapped\n", KMAP_SLOTS);
+        Halt();
+    }
+
+    int vpn = KMAP_BASE_VPN + slot;
+    kernel_page_table[vpn].valid = 1;
+    kernel_page_table[vpn].prot  = PROT_READ | PROT_WRITE;
+    kernel_page_table[vpn].pfn   = pfn;
+    kmap_state[slot] = KMAP_MAPPED;
+    return (void *)(vpn << PAGESHIFT);
+}
+
+void frame_unmap_temp(void *addr) {
+    int slot = ((unsigned int)addr >> PAGESHIFT) - KMAP_BASE_VPN;
+    kernel_page_table[KMAP_BASE_VPN + slot].valid = 0;
+    kmap_state[slot] = KMAP_STALE;
+}
+
+//======================================================================
+// Drop the TLB entries of every stale slot, making them free again
+//======================================================================
+void frame_temp_flush(void) {
+    for (int s = 0; s < KMAP_SLOTS; s++) {
+        if (kmap_state[s] == KMAP_STALE) {
+            tlb_flush_page((KMAP_BASE_VPN + s) << PAGESHIFT, TLB_R_KERNEL);
+            kmap_state[s] = KMAP_FREE;
+        }
+    }
+}
+
+//======================================================================
+// Clear a frame through the kernel mapping window
+//======================================================================
+static void zero_frame(int pfn) {
+    void *page = frame_map_temp(pfn);
+    memset(page, 0, PAGESIZE);
+    frame_unmap_temp(page);
+}
+
+//======================================================================
+// Allocate a frame whose contents are all zero, from the pre-zeroed
+// pool when possible, else by clearing a free frame now
+//======================================================================
+int get_zeroed_frame(void) {
+
+    if (num_zeroed > 0) {
+        int pfn = zero_stack[--num_zeroed];
+        claim_frame(pfn);
+        return pfn;
+    }
+
+    int pfn = get_free_frame();
+    if (pfn >= 0) {
+        zero_frame(pfn);
+    }
+    return pfn;
+}
+
+//======================================================================
+// Like map_pt_range, but every page starts out zero-filled
+//======================================================================
+int map_zeroed_pt_range(pte_t *pt, int first, int last, int prot) {
+
+    if (last - first > frames_available(FRAME_CLASS_USER)) {
+        return ERROR;
+    }
+
+    for (int vpn = first; vpn < last; vpn++) {
+        pt[vpn].valid = 1;
+        pt[vpn].prot  = prot;
+        pt[vpn].pfn   = get_zeroed_frame();
+    }
+    return 0;
+}
+
+//======================================================================
+// The shared zero frame
+//======================================================================
+static int zero_page_pfn = ERROR;
+
+void frame_zero_page_init(void) {
+    zero_page_pfn = get_zeroed_frame();
+    if (zero_page_pfn < 0) {
+        TracePrintf(0, "frame_zero_page_init: no frame for the zero page\n");
+        Halt();
+    }
+    frame_tag(zero_page_pfn, FRAME_OWNER_KERNEL, FRAME_ZERO_PAGE);
+}
+
+int frame_zero_page(void) {
+    return zero_page_pfn;
+}
+
+//======================================================================
+// Idle-time work: clear up to budget free frames into the zero pool
+//======================================================================
+void frame_zero_idle(int budget) {
+    while (budget-- > 0 && num_zeroed < ZERO_POOL_TARGET && num_free > 0) {
+        int pfn = free_stack[--num_free];
+        stack_slot[pfn] = -1;
+        zero_frame(pfn);
+        frame_table[pfn].flags = FRAME_F_ZEROED;
+        zero_stack[num_zeroed++] = pfn;
+    }
+}
+
+int frames_zeroed(void) {
+    return num_zeroed;
+}
+
+//======================================================================
+// Frame descriptors: sharing, ownership and accounting
+//======================================================================
+
+//======================================================================
+// Take another reference to an allocated frame (sharing)
+// Returns: the new reference count, or ERROR if the frame is free
+//======================================================================
+int frame_ref(int pfn) {
+    if (pfn < 0 || pfn >= num_frames || frame_table[pfn].refcount == 0) {
+        return ERROR;
+    }
+    return ++frame_table[pfn].refcount;
+}
+
+int frame_refcount(int pfn) {
+    if (pfn < 0 || pfn >= num_frames) {
+        return 0;
+    }
+    return frame_table[pfn].refcount;
+}
+
+//======================================================================
+// Record who holds a frame and what it is used for
+//======================================================================
+void frame_tag(int pfn, int owner, frame_use_t use) {
+    if (pfn < 0 || pfn >= num_frames) {
+        return;
+    }
+    frame_table[pfn].owner = owner;
+    frame_table[pfn].use   = use;
+}
+
+void frame_tag_range(pte_t *pt, int first, int last, int owner, frame_use_t use) {
+    for (int vpn = first; vpn < last; vpn++) {
+        if (pt[vpn].valid) {
+            frame_tag(pt[vpn].pfn, owner, use);
+        }
+    }
+}
+
+void frame_set_flags(int pfn, int flags) {
+    if (pfn >= 0 && pfn < num_frames) {
+        frame_table[pfn].flags |= flags;
+    }
+}
+
+void frame_clear_flags(int pfn, int flags) {
+    if (pfn >= 0 && pfn < num_frames) {
+        frame_table[pfn].flags &= ~flags;
+    }
+}
+
+//======================================================================
+// Read-only view of one frame's descriptor, or NULL if out of range
+//======================================================================
+const frame_desc_t *frame_desc(int pfn) {
+    if (pfn < 0 || pfn >= num_frames) {
+        return NULL;
+    }
+    return &frame_table[pfn];
+}
+
+//======================================================================
+// Count frames by use into counts[FRAME_NUM_USES]
+//======================================================================
+void frame_usage(int *counts) {
+    for (int u = 0; u < FRAME_NUM_USES; u++) {
+        counts[u] = 0;
+    }
+    for (int pfn = 0; pfn < num_frames; pfn++) {
+        counts[frame_table[pfn].use]++;
+    }
+}
+
+//======================================================================
+// Number of frames whose owner is pid
+//======================================================================
+int frames_owned_by(int pid) {
+    int n = 0;
+    for (int pfn = 0; pfn < num_frames; pfn++) {
+        if (frame_table[pfn].refcount > 0 && frame_table[pfn].owner == pid) {
+            n++;
+        }
+    }
+    return n;
+}
+
+//======================================================================
+// Print the frame usage summary at the given trace level
+//======================================================================
+void frame_dump_usage(int level) {
+    static const char *names[FRAME_NUM_USES] = {
+        "free", "untagged", "kernel text", "kernel data", "kernel heap",
+        "kernel stack", "page table", "user text", "user data",
+        "user heap", "user stack", "user shared", "user disk",
+        "user merged", "zero page", "buddy free"
+    };
+    int counts[FRAME_NUM_USES];
+
+    frame_usage(counts);
+    TracePrintf(level, "frames: %d total, %d free (%d zeroed)\n",
+                num_frames, frames_free(), num_zeroed);
+    for (int u = 0; u < FRAME_NUM_USES; u++) {
+        TracePrintf(level, "  %-12s %d\n", names[u], counts[u]);
+    }
+}
@@ -0,0 +1,137 @@
+/* frame.h - Physical frame allocator */
+
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include "hardware.h"
+#include "yalnix.h"
+
+//==========================================================================
+// Per-frame descriptor: how many mappings share the frame, which process
+// owns it and what it holds. Free frames have refcount 0; free frames
+// held by the buddy zone keep one reference and read FRAME_BUDDY_FREE.
+//==========================================================================
+typedef enum frame_use {
+    FRAME_FREE,
+    FRAME_UNTAGGED,
+    FRAME_KERNEL_TEXT,
+    FRAME_KERNEL_DATA,
+    FRAME_KERNEL_HEAP,
+    FRAME_KERNEL_STACK,
+    FRAME_PAGE_TABLE,
+    FRAME_USER_TEXT,
+    FRAME_USER_DATA,
+    FRAME_USER_HEAP,
+    FRAME_USER_STACK,
+    FRAME_USER_SHARED,
+    FRAME_USER_DISK,
+    FRAME_USER_MERGED,
+    FRAME_ZERO_PAGE,
+    FRAME_BUDDY_FREE,
+    FRAME_NUM_USES
+} frame_use_t;
+
+#define FRAME_OWNER_NONE    (-2)
+#define FRAME_OWNER_KERNEL  (-1)
+
+#define FRAME_F_ZEROED  0x01    /* free and known to hold all zeroes */
+#define FRAME_F_BUDDY   0x02    /* belongs to the buddy zone */
+
+typedef struct frame_desc {
+    unsigned short refcount;
+    unsigned char  use;
+    unsigned char  flags;
+    int            owner;
+} frame_desc_t;
+
+//==========================================================================
+// Free-frame stack: every free PFN sits in one array slot, and each frame
+// remembers its slot so that a specific frame can be reserved in O(1).
+// get_free_frame() and get_frame_number() hand out a frame with one
+// reference, owned by the kernel and untagged.
+// frame_is_free() is true only for frames on the stack, not for those on
+// the zero pool.
+//==========================================================================
+void frame_init(unsigned int pmem_size);
+int  get_free_frame(void);
+int  get_frame_number(int index);
+void free_frame_number(int index);
+int  frame_is_free(int index);
+int  frames_free(void);
+int  frames_total(void);
+
+//==========================================================================
+// Watermarks. User pages may not take the last frame_min frames, which are
+// kept for kernel stacks, page tables and the kernel heap; new processes
+// may not push the free count below frame_low.
+//==========================================================================
+#define FRAME_MIN_RESERVE  8
+#define FRAME_LOW_RESERVE  16
+
+typedef enum frame_class {
+    FRAME_CLASS_KERNEL,     /* kernel-critical: may use every free frame */
+    FRAME_CLASS_USER,       /* region-1 pages of a running process */
+    FRAME_CLASS_PROCESS     /* a whole new process (Fork) */
+} frame_class_t;
+
+int  frame_set_watermarks(int min, int low);
+int  frames_available(frame_class_t cls);
+
+//==========================================================================
+// Batched, all-or-nothing allocation for LoadProgram, Fork and Brk.
+// alloc_frames() is kernel class; the map_*_pt_range() helpers map
+// region-1 pages and are user class.
+//==========================================================================
+int  alloc_frames(int n, int *frames);
+void free_frames(int *frames, int n);
+int  map_pt_range(pte_t *pt, int first, int last, int prot);
+void free_pt_range(pte_t *pt, int first, int last);
+
+//==========================================================================
+// Pool of free frames cleared while the idle process runs. Clock ticks
+// that interrupt idle zero up to ZERO_POOL_BATCH frames each.
+//==========================================================================
+#define ZERO_POOL_TARGET  32
+#define ZERO_POOL_BATCH   4
+
+//==========================================================================
+// Kernel mapping window: frame_map_temp() maps a frame in one of the
+// KMAP_SLOTS pages below the kernel stack. Unmapping only marks the slot
+// stale; stale slots are flushed together when the window runs out, so a
+// run of copies costs about one flush per page instead of two.
+//==========================================================================
+void *frame_map_temp(int pfn);
+void  frame_unmap_temp(void *addr);
+void  frame_temp_flush(void);
+
+int  get_zeroed_frame(void);
+int  map_zeroed_pt_range(pte_t *pt, int first, int last, int prot);
+void frame_zero_idle(int budget);
+int  frames_zeroed(void);
+
+//==========================================================================
+// The shared zero frame: one frame of zeroes mapped read-only wherever a
+// fresh BSS or heap page (VPG_ZERO) has only been read so far. Stack
+// pages never use it: they are written almost at once, so LoadProgram and
+// vm_grow_stack give them zeroed frames of their own. The kernel holds a
+// reference of its own, so it is never freed or taken over by a write fault.
+//==========================================================================
+void frame_zero_page_init(void);
+int  frame_zero_page(void);
+
+//==========================================================================
+// Descriptor queries and updates. free_frame_number() drops a single
+// reference, so a shared frame is only freed by its last holder.
+//==========================================================================
+int  frame_ref(int pfn);
+int  frame_refcount(int pfn);
+void frame_tag(int pfn, int owner, frame_use_t use);
+void frame_tag_range(pte_t *pt, int first, int last, int owner, frame_use_t use);
+void frame_set_flags(int pfn, int flags);
+void frame_clear_flags(int pfn, int flags);
+const frame_desc_t *frame_desc(int pfn);
+void frame_usage(int *counts);
+int  frames_owned_by(int pid);
+void frame_dump_usage(int level);
+
+#endif /* _FRAME_H */
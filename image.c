@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "image.h"
+#include "frame.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Registry state. Busy and idle images share one list, most recently
+// used first, so eviction takes idle images from the tail.
+//======================================================================
+static image_t *images = NULL;
+static int      cache_hits = 0;
+static int      cache_misses = 0;
+
+//======================================================================
+// List helpers
+//======================================================================
+static void unlink_image(image_t *image) {
+    image_t **link = &images;
+    while (*link != NULL && *link != image) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        *link = image->next;
+    }
+    image->next = NULL;
+}
+
+static void push_image(image_t *image) {
+    image->next = images;
+    images = image;
+}
+
+//======================================================================
+// Release the cached frames and the file of an image nobody uses
+// Returns: the number of cached frames given back
+//======================================================================
+static int destroy_image(image_t *image) {
+    int released = image->nframes;
+
+    unlink_image(image);
+    for (int i = 0; i < image->npages; i++) {
+        if (image->pfn[i] >= 0) {
+            free_frame_number(image->pfn[i]);
+        }
+    }
+    close(image->fd);
+    free(image->pfn);
+    free(image->name);
+    free(image);
+    return released;
+}
+
+//======================================================================
+// Evict idle images, least recently used first, until at most max_idle
+// remain holding at most max_frames frames between them
+//======================================================================
+static void trim_cache(int max_idle, int max_frames) {
+    for (;;) {
+        image_t *victim = NULL;
+        int idle = 0;
+        int frames = 0;
+
+        for (image_t *image = images; image != NULL; image = image->next) {
+            if (image->refcount == 0) {
+                idle++;
+                frames += image->nframes;
+                victim = image;
+            }
+        }
+        if (victim == NULL || (idle <= max_idle && frames <= max_frames)) {
+            return;
+        }
+        TracePrintf(1, "image cache: evicting '%s' (%d frames)\n", victim->name, victim->nframes);
+        destroy_image(victim);
+    }
+}
+
+//======================================================================
+// Find the image of the executable at name without opening it. An image
+// some process is running is shared as it is. An idle one stands in for
+// opening the file again, so a stat() first confirms the file hasn't
+// been replaced; a stale entry is dropped from the registry.
+// Returns: the image with one more reference, or NULL on a miss
+//======================================================================
+image_t *image_lookup(const char *name) {
+
+    for (image_t *image = images; image != NULL; image = image->next) {
+        if (strcmp(image->name, name) != 0) {
+            continue;
+        }
+
+        struct stat st;
+        if (image->refcount == 0 &&
+            (stat(name, &st) < 0 || image->dev != st.st_dev || image->ino != st.st_ino ||
+             image->mtime != st.st_mtime || image->size != st.st_size)) {
+            TracePrintf(1, "image_lookup: '%s' changed on disk\n", name);
+            destroy_image(image);
+            break;
+        }
+
+        cache_hits++;
+        unlink_image(image);
+        push_image(image);
+        return image_get(image);
+    }
+
+    cache_misses++;
+    return NULL;
+}
+
+//======================================================================
+// Register the executable open on fd, whose header is li. The image
+// takes over fd.
+// Returns: the new image with one reference, or NULL (fd left open)
+//======================================================================
+image_t *image_open(int fd, const char *name, struct load_info *li) {
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return NULL;
+    }
+
+    int npages = li->t_npg + li->id_npg;
+    image_t *image = malloc(sizeof(image_t));
+    char *copy = malloc(strlen(name) + 1);
+    int *pfn = malloc((npages > 0 ? npages : 1) * sizeof(int));
+    if (image == NULL || copy == NULL || pfn == NULL) {
+        free(image);
+        free(copy);
+        free(pfn);
+        return NULL;
+    }
+
+    strcpy(copy, name);
+    for (int i = 0; i < npages; i++) {
+        pfn[i] = -1;
+    }
+    image->fd       = fd;
+    image->refcount = 1;
+    image->name     = copy;
+    image->dev      = st.st_dev;
+    image->ino      = st.st_ino;
+    image->mtime    = st.st_mtime;
+    image->size     = st.st_size;
+    image->li       = *li;
+    image->npages   = npages;
+    image->pfn      = pfn;
+    image->nframes  = 0;
+    image->stack_hint = 0;
+    push_image(image);
+    return image;
+}
+
+image_t *image_get(image_t *image) {
+    if (image != NULL) {
+        image->refcount++;
+    }
+    return image;
+}
+
+//======================================================================
+// Drop a reference. The last one leaves the image cached, idle, within
+// the cache limits.
+//======================================================================
+void image_put(image_t *image) {
+
+    if (image == NULL || --image->refcount > 0) {
+        return;
+    }
+    trim_cache(IMAGE_CACHE_MAX, IMAGE_CACHE_BUDGET);
+}
+
+//======================================================================
+// Cache slot of a file offset: text pages first, then initialized data
+// Returns -1 if the offset is in neither segment
+//======================================================================
+static int page_index(image_t *image, unsigned int offset) {
+    struct load_info *li = &image->li;
+
+    if (offset >= li->t_faddr && offset < li->t_faddr + (li->t_npg << PAGESHIFT)) {
+        return (offset - li->t_faddr) >> PAGESHIFT;
+    }
+    if (offset >= li->id_faddr && offset < li->id_faddr + (li->id_npg << PAGESHIFT)) {
+        return li->t_npg + ((offset - li->id_faddr) >> PAGESHIFT);
+    }
+    return -1;
+}
+
+//======================================================================
+// Cached frame holding the page at offset, or ERROR if not read yet
+//======================================================================
+int image_frame(image_t *image, unsigned int offset) {
+    int idx = page_index(image, offset);
+    if (idx < 0 || image->pfn[idx] < 0) {
+        return ERROR;
+    }
+    return image->pfn[idx];
+}
+
+//======================================================================
+// Remember pfn as the page at offset; the image takes its own reference
+// so the frame outlives the process that read it
+//======================================================================
+void image_set_frame(image_t *image, unsigned int offset, int pfn, frame_use_t use) {
+    int idx = page_index(image, offset);
+    if (idx < 0 || image->pfn[idx] >= 0) {
+        return;
+    }
+    frame_ref(pfn);
+    frame_tag(pfn, FRAME_OWNER_KERNEL, use);
+    image->pfn[idx] = pfn;
+    image->nframes++;
+}
+
+//======================================================================
+// Remember how deep the stack of a run got, for the next Exec's hint
+//======================================================================
+void image_note_stack(image_t *image, int npages, int max) {
+    if (npages > max) {
+        npages = max;
+    }
+    if (image != NULL && npages > image->stack_hint) {
+        image->stack_hint = npages;
+    }
+}
+
+//======================================================================
+// Memory pressure: evict idle images until about nframes frames are back
+// Returns: the number of cached frames released
+//======================================================================
+int image_cache_reclaim(int nframes) {
+    int released = 0;
+
+    while (released < nframes) {
+        image_t *victim = NULL;
+        for (image_t *image = images; image != NULL; image = image->next) {
+            if (image->refcount == 0) {
+                victim = image;
+            }
+        }
+        if (victim == NULL) {
+            break;
+        }
+        released += destroy_image(victim);
+    }
+    return released;
+}
+
+//======================================================================
+// Hit and miss counters for sizing the cache
+//======================================================================
+void image_cache_stats(int *hits, int *misses) {
+    *hits   = cache_hits;
+    *misses = cache_misses;
+}
+
+void image_cache_dump_stats(int level) {
+    int busy = 0, idle = 0, frames = 0;
+
+    for (image_t *image = images; image != NULL; image = image->next) {
+        if (image->refcount > 0) {
+            busy++;
+        } else {
+            idle++;
+        }
+        frames += image->nframes;
+    }
+    TracePrintf(level, "image cache: %d hits, %d misses, %d busy, %d idle, %d frames\n",
+                cache_hits, cache_misses, busy, idle, frames);
+}
@@ -0,0 +1,53 @@
+/* image.h - Registry and cache of executables backing demand-paged processes */
+
+#ifndef _IMAGE_H
+#define _IMAGE_H
+
+#include <sys/types.h>
+#include <load_info.h>
+#include "hardware.h"
+#include "yalnix.h"
+#include "frame.h"
+
+//==========================================================================
+// One open executable, shared by every process running it. The entry
+// keeps the parsed header and, once read, the frame of each text and
+// initialized-data page; later faults on the same page map that frame
+// (data copy-on-write) instead of reading the file again. Fork shares
+// the entry. When its last user goes away the entry stays cached, idle,
+// so the next Exec of the same path skips open(), LoadInfo() and read().
+//==========================================================================
+#define IMAGE_CACHE_MAX     8    /* idle images kept */
+#define IMAGE_CACHE_BUDGET  64   /* frames the idle images may hold */
+
+typedef struct image {
+    int               fd;
+    int               refcount;    /* processes using the image; 0 if idle */
+    char             *name;
+    dev_t             dev;         /* file identity: a rebuilt binary is a new image */
+    ino_t             ino;
+    time_t            mtime;
+    off_t             size;
+    struct load_info  li;          /* parsed header */
+    int               npages;      /* text pages, then initialized-data pages */
+    int              *pfn;         /* cached frame of each of those, -1 until read */
+    int               nframes;     /* frames cached */
+    int               stack_hint;  /* deepest stack of a finished run, in pages */
+    struct image     *next;        /* registry, most recently used first */
+} image_t;
+
+image_t *image_lookup(const char *name);
+image_t *image_open(int fd, const char *name, struct load_info *li);
+image_t *image_get(image_t *image);
+void     image_put(image_t *image);
+
+int  image_frame(image_t *image, unsigned int offset);
+void image_set_frame(image_t *image, unsigned int offset, int pfn, frame_use_t use);
+
+void image_note_stack(image_t *image, int npages, int max);
+
+int  image_cache_reclaim(int nframes);
+void image_cache_stats(int *hits, int *misses);
+void image_cache_dump_stats(int level);
+
+#endif /* _IMAGE_H */
@@ -1,11 +1,12 @@
 #include <stdio.h>      // for TracePrintf or debugging/logging
 #include <stdlib.h>     // for malloc, free
-#include <string.h>     // for memset, memcpy
+#include <string.h>     // for memcpy
 #include "ipc.h"       // for pipe_t, write_node_t, and Pipe functions
 #include "queue.h"      // for queue_t and queue functions
 #include "process.h"        // for PCB structure and state management
 #include "kernel.h"     // for KernelContextSwitch or related kernel functions
 #include "hardware.h"  // for PIPE_BUFFER_LEN or other defined constants
+#include "slab.h"       // for the pipe and write_node caches
 
 //=====================================================================
 // Define pipe_t and write_node_t structures
@@ -36,6 +37,20 @@ static const int CVAR_MAX  = (INT_MAX / 3) * 2; // define CVAR_MAX as 2/3 of INT
 static const int PIPE_MAX  = INT_MAX; // define PIPE_MAX as INT_MAX
 static int next_pipe_id = CVAR_MAX + 1; // define next_pipe_id as CVAR_MAX + 1
 
+//=====================================================================
+// Define the pipe and write_node slab caches
+//=====================================================================
+static slab_cache_t pipe_cache;
+static slab_cache_t write_node_cache;
+
+void PipeCacheInit(void){
+    if (slab_cache_init(&pipe_cache, "pipe", sizeof(pipe_t), PIPE_PREALLOC) < 0 ||
+        slab_cache_init(&write_node_cache, "write_node", sizeof(write_node_t), WRITE_NODE_PREALLOC) < 0){
+        TracePrintf(0, "PipeCacheInit: failed to set up pipe caches\n");
+        Halt();
+    }
+}
+
 //=====================================================================
 // Define PipeInit function
 //=====================================================================
@@ -54,7 +69,7 @@ int PipeInit(int* pipe_idp){
     }
 
     // allocate memory for the pipe
-    pipe_t* pipe = (pipe_t*)malloc(sizeof(pipe_t));
+    pipe_t* pipe = (pipe_t*)slab_alloc(&pipe_cache);
     if (pipe == NULL){
         TracePrintf(0, "PipeInit: pipe is NULL\n");
         return ERROR;
@@ -64,7 +79,7 @@ int PipeInit(int* pipe_idp){
     pipe->read_queue = queue_new();
     if (pipe->read_queue == NULL){
         TracePrintf(0, "PipeInit: read_queue is NULL\n");
-        free(pipe);
+        slab_free(&pipe_cache, pipe);
         return ERROR;
     }
 
@@ -72,8 +87,8 @@ int PipeInit(int* pipe_idp){
     pipe->write_queue = queue_new();
     if (pipe->write_queue == NULL){
         TracePrintf(0, "PipeInit: write_queue is NULL\n");
-        free(pipe->read_queue);
-        free(pipe);
+        queue_delete(pipe->read_queue);
+        slab_free(&pipe_cache, pipe);
         return ERROR;
     }
 
@@ -83,7 +98,6 @@ int PipeInit(int* pipe_idp){
     pipe->read_buffer_position = 0; // set the read_buffer_position to 0
     pipe->write_buffer_position = 0; // set the write_buffer_position to 0
     pipe->pipe_data_size = 0; // set the pipe_data_size to 0
-    memset(pipe->pipe_data, 0, sizeof(pipe->pipe_data)); // set the pipe_data to 0
     queue_add(pipes_queue, pipe); // add the pipe to the pipes_queue
     next_pipe_id++; // increment the next_pipe_id
     
@@ -233,7 +247,8 @@ int PipeRead(int pipe_id, void* buf, int len){
         queue_add(ready_processes, write_node->pcb);
 
         // free the write_node
-        free(write_node);
+        free(write_node->buf);
+        slab_free(&write_node_cache, write_node);
         
     }
 
@@ -311,7 +326,7 @@ int PipeWrite(int pipe_id, void* buf, int len){
     }
 
     // allocate memory for the write_node
-    write_node_t* write_node = (write_node_t*)malloc(sizeof(write_node_t));
+    write_node_t* write_node = (write_node_t*)slab_alloc(&write_node_cache);
     if (write_node == NULL){
         TracePrintf(0, "PipeWrite: write_node is NULL\n");
         return num_bytes;
@@ -324,7 +339,7 @@ int PipeWrite(int pipe_id, void* buf, int len){
 
     if (write_node->buf == NULL){
         TracePrintf(0, "PipeWrite: write_node->buf is NULL\n");
-        free(write_node);
+        slab_free(&write_node_cache, write_node);
         return num_bytes;
     }
 
@@ -361,7 +376,8 @@ int PipeWrite(int pipe_id, void* buf, int len){
 //=====================================================================
 static void free_write_node_cb(void *item, void *ctx, void *ctx2) {
     write_node_t* write_node = (write_node_t*)item; // cast the item to a write_node_t
-    free(write_node);
+    free(write_node->buf);
+    slab_free(&write_node_cache, write_node);
 }
 
 //=====================================================================
@@ -392,13 +408,13 @@ int Reclaim_pipe(int pipe_id){
     queue_delete_node(pipes_queue, found_pipe);
 
     // free the read_queue
-    free(found_pipe->read_queue);
+    queue_delete(found_pipe->read_queue);
 
     // free the write_queue
-    free(found_pipe->write_queue);
+    queue_delete(found_pipe->write_queue);
 
     // free the pipe
-    free(found_pipe);
+    slab_free(&pipe_cache, found_pipe);
 
     // print the pipe reclaimed
     TracePrintf(0, "PipeInit: Pipe reclaimed\n");
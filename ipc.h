@@ -16,7 +16,11 @@ typedef struct pipe pipe_t;
 // Write node structure for buffering writes when the pipe is full
 typedef struct write_node write_node_t;
 
+#define PIPE_PREALLOC        8
+#define WRITE_NODE_PREALLOC  16
+
 // Function prototypes
+void PipeCacheInit(void);
 int PipeInit(int* pipe_idp);
 int PipeRead(int pipe_id, void* buf, int len);
 int PipeWrite(int pipe_id, void* buf, int len);
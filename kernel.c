@@ -12,14 +12,21 @@
 #include "ykernel.h"
 #include "process.h"
 #include "tty.h"
+#include "buddy.h"
+#include "sync_lock.h"
+#include "sync_cvar.h"
+#include "ipc.h"
+#include "ptpool.h"
+#include "vm.h"
+#include "shm.h"
+#include "diskmap.h"
+#include "tlb.h"
 
 //======================================================================
 // CP2: Physical memory management variables
 //======================================================================
-static int num_phys_pages;           // Number of physical frames
 static int vm_off_brk;               // Kernel break when VM disabled
 static int vm_on_brk;                // Kernel break when VM enabled
-static unsigned char *frame_free;    // Bit-vector tracking free frames
 int vmem_enabled = false;
 
 //======================================================================
@@ -49,54 +56,16 @@ void DoIdle(void) {
     }
 }
 
-//======================================================================
-// CP2: Set up a way to track free frames
-//      Find and allocate a free physical frame
-//      Returns: frame index or -1 if none available
-//======================================================================
-int get_free_frame() {
-    const int BITS_PER_BYTE = 8;
-
-    // Scan each byte of the bit-vector
-    for (int i = 0; i < num_phys_pages; i++) {
-        for (int j = 0; j < BITS_PER_BYTE; j++) {
-        // Check if bit j in byte i is 0 (free)
-        if ((frame_free[i] & (1 << j)) == 0) {
-            // Mark it as used
-            frame_free[i] |= (1 << j);
-            return i * BITS_PER_BYTE + j;
-        }
-        }
-    }
-    return ERROR;
-}
-  
-//======================================================================
-// CP2: Set up a way to track free frames
-//      Mark a frame as used in the bit-vector
-//======================================================================
-void get_frame_number(int index) {
-frame_free[index / 8] |= (1 << (index % 8));
-}
-
-//======================================================================
-// CP2: Set up a way to track free frames
-//      Free a previously allocated frame in the bit-vector
-//======================================================================
-void free_frame_number(int index) {
-frame_free[index / 8] &= ~(1 << (index % 8));
-}
-
 //=======================================================================
 // CP2: Write SetKernelBrk function
 //      Adjust the kernel heap break (sbrk-like) for kernel allocations
 //      Returns 0 on success, -1 on failure
 //=======================================================================
 int SetKernelBrk(void *addr) {
-    unsigned int new_brk = UP_TO_PAGE(addr);
+    unsigned int new_brk = UP_TO_PAGE(addr) >> PAGESHIFT;
   
-    // Check bounds: cannot shrink below original or exceed VMEM_0_LIMIT
-    if (new_brk < _orig_kernel_brk_page || new_brk > VMEM_0_LIMIT) {
+    // Check bounds: cannot shrink below original or reach the page table window
+    if (new_brk < _orig_kernel_brk_page || new_brk > PT_POOL_BASE_VPN) {
       return ERROR;
     }
   
@@ -111,8 +80,13 @@ int SetKernelBrk(void *addr) {
       for (int i = vm_on_brk; i < new_brk; i++) {
         int index = get_free_frame();
         if (index == -1) {
+          for (int j = vm_on_brk; j < i; j++) {
+            free_frame_number(kernel_page_table[j].pfn);
+            kernel_page_table[j].valid = 0;
+          }
           return ERROR;  // Out of memory
         }
+        frame_tag(index, FRAME_OWNER_KERNEL, FRAME_KERNEL_HEAP);
         kernel_page_table[i].valid = 1;
         kernel_page_table[i].pfn   = index;
         kernel_page_table[i].prot  = PROT_READ | PROT_WRITE;
@@ -123,6 +97,7 @@ int SetKernelBrk(void *addr) {
       for (int i = new_brk; i < vm_on_brk; i++) {
         free_frame_number(kernel_page_table[i].pfn);
         kernel_page_table[i].valid = 0;
+        tlb_flush_page(i << PAGESHIFT, TLB_R_KERNEL);
       }
     }
   
@@ -130,6 +105,27 @@ int SetKernelBrk(void *addr) {
     return 0;
 }  
 
+//====================================================================
+// Map the heap pages malloc'ed before VM was enabled one-to-one,
+// and take their frames off the free stack
+//====================================================================
+static void MapBootHeap(void) {
+    unsigned int boot_brk = (unsigned int)_orig_kernel_brk_page + vm_off_brk;
+
+    for (unsigned int p = vm_on_brk; p < boot_brk; p++) {
+        kernel_page_table[p].valid = 1;
+        kernel_page_table[p].prot  = PROT_READ | PROT_WRITE;
+        kernel_page_table[p].pfn   = p;
+        if (get_frame_number(p) < 0) {
+            Halt();
+        }
+        frame_tag(p, FRAME_OWNER_KERNEL, FRAME_KERNEL_HEAP);
+    }
+    if (boot_brk > vm_on_brk) {
+        vm_on_brk = boot_brk;
+    }
+}
+
 //====================================================================
 // CP2: Set up the initial Region 0 page table
 // CP2: Set up a Region 1 page table for idle. 
@@ -150,7 +146,10 @@ static void SetupPageTable(void) {
     for (int p = _first_kernel_text_page; p < _first_kernel_data_page; p++) {
         kernel_page_table[p].valid = 1;
         kernel_page_table[p].prot = PROT_READ | PROT_EXEC;
-        get_frame_number(p);            // Reserve this frame
+        if (get_frame_number(p) < 0) {  // Reserve this frame
+            Halt();
+        }
+        frame_tag(p, FRAME_OWNER_KERNEL, FRAME_KERNEL_TEXT);
         kernel_page_table[p].pfn = p;   // PFN equals page number
     }
   
@@ -158,7 +157,10 @@ static void SetupPageTable(void) {
     for (int p = _first_kernel_data_page; p < _orig_kernel_brk_page; p++) {
         kernel_page_table[p].valid = 1;
         kernel_page_table[p].prot = PROT_READ | PROT_WRITE;
-        get_frame_number(p);
+        if (get_frame_number(p) < 0) {
+            Halt();
+        }
+        frame_tag(p, FRAME_OWNER_KERNEL, FRAME_KERNEL_DATA);
         kernel_page_table[p].pfn = p;
     }
   
@@ -166,7 +168,10 @@ static void SetupPageTable(void) {
     for (int p = KERNEL_STACK_BASE >> PAGESHIFT; p < KERNEL_STACK_LIMIT >> PAGESHIFT; p++) {
         kernel_page_table[p].valid = 1;
         kernel_page_table[p].pfn   = p;
-        get_frame_number(p);
+        if (get_frame_number(p) < 0) {
+            Halt();
+        }
+        frame_tag(p, FRAME_OWNER_KERNEL, FRAME_KERNEL_STACK);
         kernel_page_table[p].prot  = PROT_READ | PROT_WRITE;
     }
 
@@ -185,6 +190,16 @@ static void SetupPageTable(void) {
         Halt();
     }
   
+    //====================================================================
+    // Carve the buddy zone for contiguous kernel-stack runs. It sits at
+    // the top of memory, clear of the boot heap.
+    //====================================================================
+    buddy_init();
+
+    // Reserve the heap frames, the zone tables' included, before handing
+    // any frame out; nothing below mallocs before VM is on
+    MapBootHeap();
+
     // Give the user stack one free frame at top of space
     int index = MAX_PT_LEN - 1;
     int frame = get_free_frame();
@@ -193,8 +208,7 @@ static void SetupPageTable(void) {
     user_page_table[index].prot  = PROT_READ | PROT_WRITE;
   
     // Load base/limit registers for user (PTBR1)
-    WriteRegister(REG_PTBR1, (unsigned int)user_page_table);
-    WriteRegister(REG_PTLR1, MAX_PT_LEN);
+    tlb_load_region1(user_page_table, TLB_R_SWITCH);
 }
 
 //======================================================================
@@ -203,40 +217,33 @@ static void SetupPageTable(void) {
 //=======================================================================
 KernelContext* KCCopy(KernelContext *kc_in, void *next_pcb_p, void *useless){
 
-    PCB   *new_pcb = (PCB *)next_pcb_p;
-    pte_t *kpt = kernel_page_table;
-    const int stack_start = KERNEL_STACK_BASE  >> PAGESHIFT;
-    const int stack_end = KERNEL_STACK_LIMIT >> PAGESHIFT;
-    const int n_pages = stack_end - stack_start;
-
-    //======================================================================
-    // CP3: use the page right below the kernel stack
-    //======================================================================
-    const int temp_page = stack_start - 1;
+    PCB *new_pcb = (PCB *)next_pcb_p;
+    const int stack_start = KERNEL_STACK_BASE >> PAGESHIFT;
 
     /* Copy the incoming kernel context into the new PCB */
     new_pcb->kctxt = *kc_in;
 
-    /* Copy each kernel-stack page into the new PCB's frames */
-    for (int i = 0; i < n_pages; i++) {
-        
-        //======================================================================
-        // CP3: Temporarily map the destination frame into some page
-        //======================================================================
-        kpt[temp_page].valid = 1;
-        kpt[temp_page].prot  = PROT_READ | PROT_WRITE;
-        kpt[temp_page].pfn   = new_pcb->kstack_pfn[i];
-        WriteRegister(REG_TLB_FLUSH, (temp_page << PAGESHIFT));
-
-        /* Copy from current stack page to temp page */
-        void *src = (void *)((stack_start + i) << PAGESHIFT);
-        void *dst = (void *)(temp_page << PAGESHIFT);
-        memcpy(dst, src, PAGESIZE);
-
-        /* Unmap the temp page again */
-        kpt[temp_page].valid = 0;
-        WriteRegister(REG_TLB_FLUSH, (temp_page << PAGESHIFT));
+    //======================================================================
+    // Only the live part of the stack is copied: from a local of KCCopy
+    // up, since everything the caller left on the kernel stack lies above
+    // this frame. If KCCopy runs on some other stack, the local isn't
+    // inside the kernel stack and all of it is copied.
+    //======================================================================
+    unsigned int low = KERNEL_STACK_BASE;
+    unsigned int here = (unsigned int)&low;
+    if (here > KERNEL_STACK_BASE && here < KERNEL_STACK_LIMIT) {
+        low = here & ~(sizeof(long) - 1);
+    }
+
+    /* Copy each live piece through the kernel mapping window */
+    for (unsigned int addr = low; addr < KERNEL_STACK_LIMIT; ) {
+        unsigned int page_end = DOWN_TO_PAGE(addr) + PAGESIZE;
+        char *dst = frame_map_temp(new_pcb->kstack_pfn[(addr >> PAGESHIFT) - stack_start]);
+        memcpy(dst + (addr & PAGEOFFSET), (void *)addr, page_end - addr);
+        frame_unmap_temp(dst);
+        addr = page_end;
     }
+
     /* Return kc_in so KernelContextSwitch will resume here in the new process */
     return kc_in;
 }
@@ -262,9 +269,12 @@ KernelContext* KCSwitch(KernelContext *kc_in, void *curr_pcb_p, void *next_pcb_p
     }
   
     //======================================================================
-    // CP3: copy the current KernelContext into the old PCB
+    // CP3: copy the current KernelContext into the old PCB; an exited
+    //      process never runs again, so its context isn't kept
     //======================================================================
-    memcpy(&curr->kctxt, kc_in, sizeof(KernelContext));
+    if (curr->state != PCB_ZOMBIE) {
+      memcpy(&curr->kctxt, kc_in, sizeof(KernelContext));
+    }
 
     //========================================================================
     // CP3: change the Region 0 kernel stack mappings to those for the new PCB
@@ -273,21 +283,33 @@ KernelContext* KCSwitch(KernelContext *kc_in, void *curr_pcb_p, void *next_pcb_p
     // Kernel stack lies in Region 0 from KERNEL_STACK_BASE to KERNEL_STACK_LIMIT
     int start = KERNEL_STACK_BASE >> PAGESHIFT;
     int end   = KERNEL_STACK_LIMIT >> PAGESHIFT;
+    int remapped = 0;
     for (int vpn = start; vpn < end; vpn++) {
+      if (kernel_page_table[vpn].valid &&
+          kernel_page_table[vpn].pfn == next->kstack_pfn[vpn - start]) {
+        continue;
+      }
       kernel_page_table[vpn].valid = 1;
       kernel_page_table[vpn].prot  = PROT_READ | PROT_WRITE;
       // Map virtual page vpn to the PFN stored in next->kstack_pfn[vpn - start]
       kernel_page_table[vpn].pfn   = next->kstack_pfn[vpn - start];
+      remapped = 1;
     }
   
     // Flush the old stack mappings so the new ones take effect
-    WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_KSTACK);
+    if (remapped) {
+      tlb_flush_kstack(TLB_R_SWITCH);
+    }
   
-    // Switch to the *next* process’s region-1 page table
-    WriteRegister(REG_PTBR1, (unsigned int)next->region1_pt);
-    WriteRegister(REG_PTLR1, MAX_PT_LEN);
+    // Switch to the *next* process’s region-1 page table; the rest of
+    // region 0 is the same for everyone and stays in the TLB
+    tlb_load_region1(next->region1_pt, TLB_R_SWITCH);
 
-    WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_ALL);
+    // KCSwitch runs off the process's kernel stack, so an exited
+    // process's table, stack and PCB can go now that none is loaded
+    if (curr->state == PCB_ZOMBIE) {
+      FreeExitedPCB(curr);
+    }
   
     currentPCB = next;
 
@@ -308,11 +330,7 @@ void KernelStart(char *cmd_args[], unsigned int pmem_size, UserContext *uctxt) {
     //====================================================================
     // CP2: Set up a way to track free frames
     //====================================================================
-    num_phys_pages = (int)(pmem_size >> PAGESHIFT) / 8;
-    frame_free = calloc(num_phys_pages, sizeof(unsigned char));
-    for (int i = 0; i < num_phys_pages; i++) {
-        frame_free[i] = 0;
-    }
+    frame_init(pmem_size);
 
 
     //====================================================================
@@ -322,21 +340,11 @@ void KernelStart(char *cmd_args[], unsigned int pmem_size, UserContext *uctxt) {
     SetupPageTable();
 
     //====================================================================
-    // CP2: adjust the page table appropriately before turning VM on
+    // CP2: the boot heap must be mapped in full before turning VM on
     //====================================================================
-    unsigned int new_brk_page  = (unsigned int)_orig_kernel_brk_page + vm_off_brk;
-    if (new_brk_page > vm_on_brk) {
-
-        for (unsigned int p = vm_on_brk; p < new_brk_page; p++) {
-            int f = get_free_frame();
-            if (f < 0){
-                Halt();              // out of memory?
-            }
-            kernel_page_table[p].valid = 1;
-            kernel_page_table[p].pfn   = f;
-            kernel_page_table[p].prot  = PROT_READ | PROT_WRITE;
-        }
-        vm_on_brk = new_brk_page;
+    if ((unsigned int)_orig_kernel_brk_page + vm_off_brk > vm_on_brk) {
+        TracePrintf(0, "KernelStart: kernel heap grew past the boot mapping\n");
+        Halt();
     }
 
     //====================================================================
@@ -351,9 +359,25 @@ void KernelStart(char *cmd_args[], unsigned int pmem_size, UserContext *uctxt) {
     TrapInit();
     WriteRegister(REG_VECTOR_BASE, (unsigned int)interruptVector);
 
+    //====================================================================
+    // Set up the slab caches for the hot kernel objects
+    //====================================================================
+    queue_cache_init();
+    PCBCacheInit();
+    LockCacheInit();
+    CvarCacheInit();
+    PipeCacheInit();
+
     initQueues();
     TtyInit();
 
+    frame_zero_page_init();
+
+    // Warm the kernel-stack pool so the first Forks don't allocate
+    for (int i = 0; i < KSTACK_POOL_MIN; i++) {
+        KernelStackPoolFill();
+    }
+
 
     //====================================================================
     // CP2: create and initialize idle PCB
@@ -390,19 +414,15 @@ void KernelStart(char *cmd_args[], unsigned int pmem_size, UserContext *uctxt) {
     }
 
 
-    WriteRegister(REG_PTBR1, (unsigned int)idlePCB->region1_pt);
-    WriteRegister(REG_PTLR1, MAX_PT_LEN);
+    tlb_load_region1(idlePCB->region1_pt, TLB_R_SWITCH);
 
     //=====================================================================
     // CP3: set up region 1 page table (all invalid) for init process
     //=====================================================================
-    pte_t* temp = calloc(MAX_PT_LEN, sizeof(pte_t));
+    pte_t* temp = pt_alloc();
     if (temp == NULL){ 
         Halt();
     }
-    for (int i = 0; i < MAX_PT_LEN; i++) {
-        temp[i].valid = 0;
-    }
 
     //=====================================================================
     // CP3: create and initialize init PCB
@@ -417,11 +437,9 @@ void KernelStart(char *cmd_args[], unsigned int pmem_size, UserContext *uctxt) {
     //=====================================================================
     // CP3: set up the kernel stack frames for the init process
     //=====================================================================
-    for (int i = 0; i < KERNEL_STACK_BASE_TO_LIMIT; i++) {
-        int frame = get_free_frame();
-        if (frame < 0) Halt();
-        initPCB->kstack_pfn[i] = frame;
-    } 
+    if (AllocKernelStack(initPCB->kstack_pfn) < 0) {
+        Halt();
+    }
 
     // right after your for-loop that fills initPCB->kstack_pfn[...]:
     if (LoadProgram(cmd_args[0], cmd_args, initPCB) < 0) {
@@ -434,14 +452,12 @@ void KernelStart(char *cmd_args[], unsigned int pmem_size, UserContext *uctxt) {
   
     if (currentPCB == initPCB) {
        memcpy(uctxt, &initPCB->uctxt, sizeof(UserContext));
-       WriteRegister(REG_PTBR1, (unsigned int)initPCB->region1_pt);
-       WriteRegister(REG_PTLR1, MAX_PT_LEN);
+       tlb_load_region1(initPCB->region1_pt, TLB_R_SWITCH);
     }
 
     if (currentPCB == idlePCB) {
         memcpy(uctxt, &idlePCB->uctxt, sizeof(UserContext));
-        WriteRegister(REG_PTBR1, (unsigned int)idlePCB->region1_pt);
-        WriteRegister(REG_PTLR1, MAX_PT_LEN);
+        tlb_load_region1(idlePCB->region1_pt, TLB_R_SWITCH);
     }
 
 
@@ -468,31 +484,45 @@ int LoadProgram(char *name, char *args[], PCB* proc) {
     int data_pg1;
     int data_npg;
     int stack_npg;
-    long segment_size;
     char *argbuf;
   
   
     pte_t *saved_ptbr1 = currentPCB->region1_pt;
   
     /*
-     * Open the executable file
+     * A recently run executable is still in the image cache, header and
+     * all; only on a miss is the file opened and parsed. The image keeps
+     * the file open for as long as some process may still fault pages
+     * in from it, and processes running the same executable share it.
      */
-    if ((fd = open(name, O_RDONLY)) < 0) {
-      TracePrintf(0, "LoadProgram: can't open file '%s'\n", name);
-      return ERROR;
-    }
+    image_t *image = image_lookup(name);
+    if (image == NULL) {
+      /*
+       * Open the executable file
+       */
+      if ((fd = open(name, O_RDONLY)) < 0) {
+        TracePrintf(0, "LoadProgram: can't open file '%s'\n", name);
+        return ERROR;
+      }
   
-    if (LoadInfo(fd, &li) != LI_NO_ERROR) {
-      TracePrintf(0, "LoadProgram: '%s' not in Yalnix format\n", name);
-      close(fd);
-      return (ERROR);
-    }
+      if (LoadInfo(fd, &li) != LI_NO_ERROR) {
+        TracePrintf(0, "LoadProgram: '%s' not in Yalnix format\n", name);
+        close(fd);
+        return (ERROR);
+      }
   
-    if (li.entry < VMEM_1_BASE) {
-      TracePrintf(0, "LoadProgram: '%s' not linked for Yalnix\n", name);
-      close(fd);
-      return ERROR;
+      if (li.entry < VMEM_1_BASE) {
+        TracePrintf(0, "LoadProgram: '%s' not linked for Yalnix\n", name);
+        close(fd);
+        return ERROR;
+      }
+
+      if ((image = image_open(fd, name, &li)) == NULL) {
+        close(fd);
+        return ERROR;
+      }
     }
+    li = image->li;
   
     /*
      * Figure out in what region 1 page the different program sections
@@ -553,9 +583,26 @@ int LoadProgram(char *name, char *args[], PCB* proc) {
   
     /* leave at least one page between heap and stack */
     if (stack_npg + data_pg1 + data_npg >= MAX_PT_LEN) {
-      close(fd);
+      image_put(image);
+      return ERROR;
+    }
+
+    /*
+     * Text and data are paged in from the file on first touch; only the
+     * stack holding the arguments is built now. Its frames are taken
+     * before anything is thrown away, so nothing past the commit point
+     * below can run out of memory. The old region 1 may be shared or may
+     * sleep on the disk while it goes, so its frames aren't counted on.
+     */
+    int stack_frames[MAX_PT_LEN];
+    if (vm_reclaim(FRAME_CLASS_USER, stack_npg) < 0) {
+      TracePrintf(0, "LoadProgram: '%s' needs %d frames, not enough free\n", name, stack_npg);
+      image_put(image);
       return ERROR;
     }
+    for (i = 0; i < stack_npg; i++) {
+      stack_frames[i] = get_zeroed_frame();
+    }
   
     /*
      * This completes all the checks before we proceed to actually load
@@ -605,17 +652,13 @@ int LoadProgram(char *name, char *args[], PCB* proc) {
      * ==>> for every valid page, free the pfn and mark the page invalid.
      */
   
-    for (int i = 0; i <MAX_PT_LEN; i++){
-    
-      if (proc->region1_pt[i].valid){
-      
-        free_frame_number(proc->region1_pt[i].pfn);
-  
-        proc->region1_pt[i].valid = 0;
-      
-      }
-    
-    }
+    ShmDetachAll(proc);
+    DiskUnmapAll(proc);
+    image_note_stack(proc->image, vm_stack_pages(proc), vm_stack_hint_max());
+    free_pt_range(proc->region1_pt, 0, MAX_PT_LEN);
+    vm_clear_range(proc, 0, MAX_PT_LEN);
+    image_put(proc->image);
+    proc->image = image;
   
     /*
      * ==>> Then, build up the new region1.
@@ -625,78 +668,39 @@ int LoadProgram(char *name, char *args[], PCB* proc) {
     /*
      * ==>> First, text. Allocate "li.t_npg" physical pages and map them starting at
      * ==>> the "text_pg1" page in region 1 address space.
-     * ==>> These pages should be marked valid, with a protection of
-     * ==>> (PROT_READ | PROT_WRITE).
+     *
+     * Text pages are left not present, each backed by its page of the
+     * file; the first fetch from one reads it in and maps it
+     * (PROT_READ | PROT_EXEC).
      */
   
     int text_top = text_pg1+ li.t_npg;
   
-  
-    for (int i = text_pg1; i < text_top; i++){
-    
-      int index = get_free_frame();
-  
-      if (index < 0){
-      
-        for (int i = text_pg1; i < text_top; i++){
-        
-          if (proc->region1_pt[i].valid) {
-          
-            free_frame_number(proc->region1_pt[i].pfn);
-            proc->region1_pt[i].valid = 0;
-            
-          }
-      
-        } 
-        return ERROR;
-    
-      }
-      
-      proc->region1_pt[i].pfn = index;
-      proc->region1_pt[i].valid = 1;
-      proc->region1_pt[i].prot = PROT_READ | PROT_WRITE;
-  
-    }
-  
-  
+    vm_set_backing(proc, text_pg1, text_top, VPG_FILE, PROT_READ | PROT_EXEC,
+                   FRAME_USER_TEXT, li.t_faddr, li.t_npg << PAGESHIFT);
   
   
     /*
      * ==>> Then, data. Allocate "data_npg" physical pages and map them starting at
      * ==>> the  "data_pg1" in region 1 address space.
-     * ==>> These pages should be marked valid, with a protection of
-     * ==>> (PROT_READ | PROT_WRITE).
+     *
+     * Initialized data is backed by the file up to id_end, which leaves
+     * the tail of its last page zero; BSS pages are zero-filled on demand.
+     * All of them become (PROT_READ | PROT_WRITE) when touched.
      */
   
     int heap_top = data_pg1 + data_npg;
   
-    for (int i = data_pg1; i < heap_top; i++){
-    
-      int index = get_free_frame();
-  
-      if (index < 0){
-      
-        for (int i = data_pg1; i < heap_top;i++){
-        
-          if (proc->region1_pt[i].valid) {
-          
-            free_frame_number(proc->region1_pt[i].pfn);
-            proc->region1_pt[i].valid = 0;
-            
-          }
-      
-        } 
-        return ERROR;
-    
-      }
-      
-      proc->region1_pt[i].pfn = index;
-      proc->region1_pt[i].valid = 1;
-      proc->region1_pt[i].prot = PROT_READ | PROT_WRITE;
+    int bss_pg1 = data_pg1 + li.id_npg;
   
-    }
+    vm_set_backing(proc, data_pg1, bss_pg1, VPG_FILE, PROT_READ | PROT_WRITE,
+                   FRAME_USER_DATA, li.id_faddr, li.id_end - li.id_vaddr);
+    vm_set_backing(proc, bss_pg1, heap_top, VPG_ZERO, PROT_READ | PROT_WRITE,
+                   FRAME_USER_DATA, 0, 0);
 
-    proc->brk = (void*)((heap_top << PAGESHIFT) + VMEM_1_BASE); //FIXME: Is this correct?
+    // The break starts on the page right after BSS; Brk rounds it up the
+    // same way, so the two agree on where the heap ends
+    proc->brk = (void*)((heap_top << PAGESHIFT) + VMEM_1_BASE);
   
   
     /*
@@ -708,102 +712,48 @@ int LoadProgram(char *name, char *args[], PCB* proc) {
   
     int stack_start = MAX_PT_LEN -stack_npg;
   
-    for (int i = stack_start; i < MAX_PT_LEN; i++){
-    
-      int index = get_free_frame();
-  
-      if (index < 0){
-      
-        for (int i = stack_start; i < MAX_PT_LEN;i++){
-        
-          if (proc->region1_pt[i].valid) {
-          
-            free_frame_number(proc->region1_pt[i].pfn);
-            proc->region1_pt[i].valid = 0;
-            
-          }
-      
-        } 
-        return ERROR;
-    
-      }
-      
-      proc->region1_pt[i].pfn = index;
+    for (i = stack_start; i < MAX_PT_LEN; i++) {
       proc->region1_pt[i].valid = 1;
-      proc->region1_pt[i].prot = PROT_READ | PROT_WRITE;
-  
+      proc->region1_pt[i].prot  = PROT_READ | PROT_WRITE;
+      proc->region1_pt[i].pfn   = stack_frames[i - stack_start];
     }
-  
-  
-    /*
-     * ==>> (Finally, make sure that there are no stale region1 mappings left in the TLB!)
-     */
-  
-    // 1) Flush any old region-1 mappings
-    WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_1);
-  
-    // 2) Tell the MMU to use THIS process page table
-    WriteRegister(REG_PTBR1, (unsigned int)proc->region1_pt);
-    WriteRegister(REG_PTLR1, MAX_PT_LEN);
-  
-    // 3) Flush again to clear any stale entries under the new table
-    WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_1);
-  
-    /*
-     * All pages for the new address space are now in the page table.
-     */
-  
+
     /*
-     * Read the text from the file into memory.
+     * If earlier runs of this program grew a deeper stack, map that much
+     * now, as far as spare frames and the gap above the heap allow.
      */
-    lseek(fd, li.t_faddr, SEEK_SET);
-    segment_size = li.t_npg << PAGESHIFT;
-    if (read(fd, (void *) li.t_vaddr, segment_size) != segment_size) {
-      close(fd);
-      return KILL;   // see ykernel.h
+    int hint_npg = image->stack_hint < vm_stack_hint_max() ? image->stack_hint : vm_stack_hint_max();
+    hint_npg -= stack_npg;
+    if (hint_npg > stack_start - heap_top - 1) {
+      hint_npg = stack_start - heap_top - 1;
     }
-  
-    /*
-     * Read the data from the file into memory.
-     */
-    lseek(fd, li.id_faddr, 0);
-    segment_size = li.id_npg << PAGESHIFT;
-  
-    if (read(fd, (void *) li.id_vaddr, segment_size) != segment_size) {
-      close(fd);
-      return KILL;
+    if (hint_npg > frames_available(FRAME_CLASS_USER)) {
+      hint_npg = frames_available(FRAME_CLASS_USER);
+    }
+    if (hint_npg > 0 &&
+        map_zeroed_pt_range(proc->region1_pt, stack_start - hint_npg, stack_start, PROT_READ | PROT_WRITE) == 0) {
+      stack_start -= hint_npg;
     }
   
   
-    close(fd);                    /* we've read it all now */
+    frame_tag_range(proc->region1_pt, stack_start, MAX_PT_LEN, proc->pid, FRAME_USER_STACK);
   
   
     /*
-     * ==>> Above, you mapped the text pages as writable, so this code could write
-     * ==>> the new text there.
-     *
-     * ==>> But now, you need to change the protections so that the machine can execute
-     * ==>> the text.
-     *
-     * ==>> For each text page in region1, change the protection to (PROT_READ | PROT_EXEC).
-     * ==>> If any of these page table entries is also in the TLB,
-     * ==>> you will need to flush the old mapping.
+     * ==>> (Finally, make sure that there are no stale region1 mappings left in the TLB!)
      */
   
-  
-    for (int i = text_pg1; i < text_top; i++){
-  
-      proc->region1_pt[i].prot = PROT_READ | PROT_EXEC;
-  
+    // Exec rewrote the loaded table in place, so its old entries must go;
+    // a table that isn't loaded yet is flushed once when it is loaded
+    if (tlb_region1() == proc->region1_pt) {
+      tlb_flush_region1(TLB_R_EXEC);
+    } else {
+      tlb_load_region1(proc->region1_pt, TLB_R_EXEC);
     }
   
-    WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_1);
-  
-  
     /*
-     * Zero out the uninitialized data area
+     * The stack is now in the page table; text and data come in on demand.
      */
-    bzero((void*)li.id_end, li.ud_end - li.id_end);
   
     /*
      * Set the entry point in the process's UserContext
@@ -821,7 +771,7 @@ int LoadProgram(char *name, char *args[], PCB* proc) {
      */
   
   
-    memset(cpp, 0x00, VMEM_1_LIMIT - ((int) cpp));
+    /* The stack pages are freshly zeroed, so the argument area already is */
   
     *cpp++ = (char *)argcount;            /* the first value at cpp is argc */
     cp2 = argbuf;
@@ -837,9 +787,7 @@ int LoadProgram(char *name, char *args[], PCB* proc) {
   
   
     // --- restore the original R1 mapping before returning ---
-    WriteRegister(REG_PTBR1, (unsigned int)saved_ptbr1);
-    WriteRegister(REG_PTLR1, MAX_PT_LEN);
-    WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_1);
+    tlb_load_region1(saved_ptbr1, TLB_R_EXEC);
   
     return SUCCESS;
   
@@ -5,6 +5,7 @@
 
 #include "hardware.h"
 #include "yalnix.h"
+#include "frame.h"
 
 /* Forward declarations */
 typedef struct pcb PCB;
@@ -18,6 +19,10 @@ extern unsigned int kernel_text_start; /* Start of kernel text segment */
 extern unsigned int kernel_text_end;   /* End of kernel text segment */
 extern unsigned int user_stack_limit;  /* Limit for user stack growth */
 
+/* Region 0 window just below the kernel stack, for touching arbitrary frames */
+#define KMAP_SLOTS      8
+#define KMAP_BASE_VPN   ((KERNEL_STACK_BASE >> PAGESHIFT) - KMAP_SLOTS)
+
 /* Page table pointers */
 extern pte_t *kernel_page_table;   /* Page table for kernel region */
 extern pte_t **process_page_tables; /* Array of page tables for user processes */
@@ -29,8 +34,6 @@ void KernelInit(void);
 void BootstrapInit(UserContext *uctxt);
 void LoadInitProcess(UserContext *uctxt);
 void EnableVirtualMemory(void);
-int get_free_frame();
-void free_frame_number(int index);
 void DoIdle(void);
 
 extern PCB *idlePCB;         /* The one and only idle process */
@@ -0,0 +1,228 @@
+#include <string.h>
+#include "ksm.h"
+#include "frame.h"
+#include "vm.h"
+#include "process.h"
+#include "kernel.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Hash table of pages seen. An entry either names a merged frame
+// (pid < 0), whose every mapping is read-only, or the page vpn of pid
+// that held pfn when it was hashed; that one is checked again before use.
+//======================================================================
+typedef struct ksm_entry {
+    unsigned int hash;
+    int          pfn;      // -1 if the slot is empty
+    int          pid;
+    int          vpn;
+} ksm_entry_t;
+
+static ksm_entry_t table[KSM_TABLE_SIZE];
+static int table_ready = 0;
+static int scan_rate   = KSM_SCAN_RATE;
+static int hand        = 0;     // Position over (process, vpn), advances per page
+static int scanned     = 0;
+static int compared    = 0;
+static int merged      = 0;
+
+//======================================================================
+// FNV-1a over the words of a page
+//======================================================================
+static unsigned int hash_page(const unsigned int *words) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < PAGESIZE / (int)sizeof(unsigned int); i++) {
+        h = (h ^ words[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int same_frames(int a, int b) {
+    void *pa = frame_map_temp(a);
+    void *pb = frame_map_temp(b);
+    int same = memcmp(pa, pb, PAGESIZE) == 0;
+    frame_unmap_temp(pb);
+    frame_unmap_temp(pa);
+    compared++;
+    return same;
+}
+
+//======================================================================
+// Processes whose pages may be scanned: those that can't run right now
+//======================================================================
+static void collect_cb(void *item, void *ctx, void *ctx2) {
+    PCB  *pcb   = (PCB *)item;
+    PCB **procs = (PCB **)ctx;
+    int  *n     = (int *)ctx2;
+
+    if (pcb != currentPCB && pcb != idlePCB && *n < MAX_PROCS) {
+        procs[(*n)++] = pcb;
+    }
+}
+
+static PCB *find_proc(PCB **procs, int n, int pid) {
+    for (int i = 0; i < n; i++) {
+        if (procs[i]->pid == pid) {
+            return procs[i];
+        }
+    }
+    return NULL;
+}
+
+//======================================================================
+// Can page vpn of pcb be merged? Private user data, heap and stack only
+//======================================================================
+static int candidate(PCB *pcb, int vpn) {
+    pte_t *pte = &pcb->region1_pt[vpn];
+    if (!pte->valid || frame_refcount(pte->pfn) != 1 ||
+        (pcb->vpages[vpn].flags & (VPG_SHARED | VPG_PIN | VPG_DMAP))) {
+        return 0;
+    }
+    int use = frame_desc(pte->pfn)->use;
+    return use == FRAME_USER_DATA || use == FRAME_USER_HEAP || use == FRAME_USER_STACK;
+}
+
+//======================================================================
+// Make page vpn of pcb read-only onto frame pfn. A writable page becomes
+// copy-on-write and remembers its use for the copy a write will make.
+// pcb isn't running, and switching to it flushes region 1.
+//======================================================================
+static void share_page(PCB *pcb, int vpn, int pfn) {
+    pte_t   *pte = &pcb->region1_pt[vpn];
+    vpage_t *vp  = &pcb->vpages[vpn];
+
+    vp->use = frame_desc(pte->pfn)->use;
+    if (pte->prot & PROT_WRITE) {
+        pte->prot &= ~PROT_WRITE;
+        vp->flags |= VPG_COW;
+    }
+    if (pte->pfn != pfn) {
+        frame_ref(pfn);
+        free_frame_number(pte->pfn);
+        pte->pfn = pfn;
+    }
+}
+
+//======================================================================
+// Hash one page and merge it with an identical page seen before
+//======================================================================
+static void scan_page(PCB **procs, int n, PCB *pcb, int vpn) {
+    int pfn = pcb->region1_pt[vpn].pfn;
+
+    void *page = frame_map_temp(pfn);
+    unsigned int h = hash_page(page);
+    frame_unmap_temp(page);
+    scanned++;
+
+    ksm_entry_t *e = &table[h % KSM_TABLE_SIZE];
+    int canon = -1;
+    if (e->pfn >= 0 && e->hash == h && e->pfn != pfn) {
+        if (e->pid < 0) {
+            // Still a merged frame? A freed one may have been reused
+            if (frame_refcount(e->pfn) > 0 && frame_desc(e->pfn)->use == FRAME_USER_MERGED) {
+                canon = e->pfn;
+            }
+        } else {
+            PCB *owner = find_proc(procs, n, e->pid);
+            if (owner != NULL && candidate(owner, e->vpn) &&
+                owner->region1_pt[e->vpn].pfn == e->pfn) {
+                canon = e->pfn;
+            }
+        }
+    }
+
+    if (canon >= 0 && same_frames(canon, pfn)) {
+        if (e->pid >= 0) {
+            share_page(find_proc(procs, n, e->pid), e->vpn, canon);
+            frame_tag(canon, FRAME_OWNER_KERNEL, FRAME_USER_MERGED);
+            e->pid = -1;
+        }
+        share_page(pcb, vpn, canon);
+        merged++;
+        return;
+    }
+
+    // Remember this page unless the slot holds a live merged frame
+    if (canon < 0 || e->pid >= 0) {
+        e->hash = h;
+        e->pfn  = pfn;
+        e->pid  = pcb->pid;
+        e->vpn  = vpn;
+    }
+}
+
+//======================================================================
+// Scan up to the configured number of candidate pages; called on clock
+// ticks that interrupt idle. The hand looks at every page of every
+// eligible process at most once per call.
+//======================================================================
+void ksm_scan(void) {
+
+    if (scan_rate == 0) {
+        return;
+    }
+    if (!table_ready) {
+        for (int i = 0; i < KSM_TABLE_SIZE; i++) {
+            table[i].pfn = -1;
+        }
+        table_ready = 1;
+    }
+
+    PCB *procs[MAX_PROCS];
+    int  n = 0;
+    queue_iterate(blocked_processes, collect_cb, procs, &n);
+    queue_iterate(waiting_parent_processes, collect_cb, procs, &n);
+    if (n == 0) {
+        return;
+    }
+
+    int done   = 0;
+    int budget = n * MAX_PT_LEN;
+    while (done < scan_rate && budget-- > 0) {
+        PCB *pcb = procs[(hand / MAX_PT_LEN) % n];
+        int  vpn = hand % MAX_PT_LEN;
+        hand = (hand + 1) % (MAX_PROCS * MAX_PT_LEN);
+
+        if (candidate(pcb, vpn)) {
+            scan_page(procs, n, pcb, vpn);
+            done++;
+        }
+    }
+}
+
+//======================================================================
+// Pages hashed per idle tick; 0 turns scanning off
+// Returns 0, or ERROR if the rate is negative
+//======================================================================
+int ksm_set_rate(int pages_per_tick) {
+    if (pages_per_tick < 0) {
+        return ERROR;
+    }
+    scan_rate = pages_per_tick;
+    return 0;
+}
+
+//======================================================================
+// Counters; frames saved is each merged frame's mappings beyond the first
+//======================================================================
+void ksm_stats(ksm_stats_t *stats) {
+    stats->scanned  = scanned;
+    stats->compared = compared;
+    stats->merged   = merged;
+    stats->saved    = 0;
+    for (int pfn = 0; pfn < frames_total(); pfn++) {
+        const frame_desc_t *d = frame_desc(pfn);
+        if (d->use == FRAME_USER_MERGED && d->refcount > 1) {
+            stats->saved += d->refcount - 1;
+        }
+    }
+}
+
+void ksm_dump_stats(int level) {
+    ksm_stats_t s;
+    ksm_stats(&s);
+    TracePrintf(level, "ksm: %d pages scanned, %d compared, %d merged, %d frames saved\n",
+                s.scanned, s.compared, s.merged, s.saved);
+}
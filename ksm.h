@@ -0,0 +1,32 @@
+/* ksm.h - Same-page merging of identical user pages, run from idle time */
+
+#ifndef _KSM_H
+#define _KSM_H
+
+#include "hardware.h"
+#include "yalnix.h"
+
+//==========================================================================
+// While idle has the CPU, each clock tick hashes up to the configured rate
+// of private data, heap and stack pages of blocked processes. A page whose
+// contents match a page seen before is remapped read-only, copy-on-write,
+// onto that page's frame, which becomes FRAME_USER_MERGED; the write fault
+// that breaks the share is the ordinary copy-on-write one. Shared memory,
+// disk-mapped and pinned pages are never merged.
+//==========================================================================
+#define KSM_TABLE_SIZE  256   /* remembered page hashes */
+#define KSM_SCAN_RATE   8     /* default pages hashed per idle tick; 0 disables */
+
+typedef struct ksm_stats {
+    int scanned;     /* pages hashed */
+    int compared;    /* hash matches checked byte by byte */
+    int merged;      /* pages remapped onto another frame */
+    int saved;       /* frames currently saved by merging */
+} ksm_stats_t;
+
+void ksm_scan(void);
+int  ksm_set_rate(int pages_per_tick);
+void ksm_stats(ksm_stats_t *stats);
+void ksm_dump_stats(int level);
+
+#endif /* _KSM_H */
@@ -3,6 +3,24 @@
 #include "yalnix.h"
 #include "hardware.h"
 #include "kernel.h"
+#include "frame.h"
+#include "buddy.h"
+#include "slab.h"
+#include "ptpool.h"
+
+//============================================
+// Slab cache for PCBs
+//============================================
+static slab_cache_t pcb_cache;
+static slab_cache_t zombie_cache;
+
+void PCBCacheInit(void) {
+  if (slab_cache_init(&pcb_cache, "pcb", sizeof(PCB), PCB_PREALLOC) < 0 ||
+      slab_cache_init(&zombie_cache, "zombie", sizeof(zombie_t), 0) < 0) {
+    TracePrintf(0, "Failed to initialize PCB cache\n");
+    Halt();
+  }
+}
 
 //============================================
 // CP4:- Tracking queues for round-robin
@@ -38,7 +56,7 @@ void initQueues(void) {
 //==========================================================================
 PCB* CreatePCB(pte_t* user_page_table, UserContext* uctxt) {
 
-  PCB* newPCB = malloc(sizeof(PCB));
+  PCB* newPCB = slab_alloc(&pcb_cache);
 
   if (newPCB == NULL){
     Halt();
@@ -55,10 +73,18 @@ PCB* CreatePCB(pte_t* user_page_table, UserContext* uctxt) {
   newPCB->parent = NULL; // Initialize parent pointer to NULL
   newPCB->children = queue_new(); // Initialize children queue
   newPCB->state = PCB_READY; // Set initial state to READY
+  newPCB->read_buffer = NULL;
+  newPCB->read_buffer_size = 0;
+  newPCB->write_buffer = NULL;
+  newPCB->write_buffer_size = 0;
+  newPCB->kernel_read_buffer = NULL;
+  newPCB->kernel_read_buffer_size = 0;
+  memset(newPCB->vpages, 0, sizeof(newPCB->vpages));
+  newPCB->image = NULL;
 
   if (newPCB->children == NULL) {
     TracePrintf(0, "Failed to create children queue for new PCB\n");
-    free(newPCB);
+    slab_free(&pcb_cache, newPCB);
     Halt();
   }
 
@@ -71,6 +97,21 @@ PCB* CreatePCB(pte_t* user_page_table, UserContext* uctxt) {
 
 }
 
+//==========================================================================
+// Release the region-1 frames, backing state and image of pcb. The page
+// table itself is left to the caller: an exiting process is still running
+// on it, so it can only go once KCSwitch has loaded another.
+//==========================================================================
+static void ReleaseAddressSpace(PCB* pcb) {
+
+  if (pcb->region1_pt != NULL) {
+    free_pt_range(pcb->region1_pt, 0, MAX_PT_LEN);
+    vm_clear_range(pcb, 0, MAX_PT_LEN);
+  }
+  image_put(pcb->image);
+  pcb->image = NULL;
+}
+
 void DeallocatePCB(PCB* pcb) {
 
   // check if the pcb is NULL
@@ -81,7 +122,186 @@ void DeallocatePCB(PCB* pcb) {
   // free the children queue
   queue_delete(pcb->children);
 
+  // release the region-1 frames and return the page table to the pool
+  ReleaseAddressSpace(pcb);
+  pt_free(pcb->region1_pt);
+  helper_retire_pid(pcb->pid);
+
   // free the pcb
-  free(pcb);
+  slab_free(&pcb_cache, pcb);
+
+}
+
+//==========================================================================
+// Exit: orphan pcb's children, drop the records of those already dead,
+// hand its parent a zombie record and free its address space. Only the
+// page table and kernel stack it is still running on and the PCB itself
+// are left.
+//==========================================================================
+static void orphan_cb(void *item, void *ctx, void *ctx2) {
+  ((PCB *)item)->parent = NULL;
+}
+
+static int own_zombie_cb(void *item, void *ctx) {
+  zombie_t *z = (zombie_t *)item;
+  if (z->parent != (PCB *)ctx) {
+    return 0;
+  }
+  FreeZombie(z);
+  return 1;
+}
+
+void ExitPCB(PCB* pcb, int status) {
+
+  queue_iterate(pcb->children, orphan_cb, NULL, NULL);
+  queue_delete_if(zombie_processes, own_zombie_cb, pcb);
+
+  pcb->exit_status = status;
+  pcb->state = PCB_ZOMBIE;
+  if (pcb->parent != NULL) {
+    zombie_t *z = slab_alloc(&zombie_cache);
+    if (z == NULL) {
+      TracePrintf(0, "ExitPCB: no memory for the zombie record of %d\n", pcb->pid);
+      Halt();
+    }
+    z->pid = pcb->pid;
+    z->exit_status = status;
+    z->parent = pcb->parent;
+    queue_delete_node(pcb->parent->children, pcb);
+    queue_add(zombie_processes, z);
+  } else {
+    helper_retire_pid(pcb->pid);
+  }
+
+  ReleaseAddressSpace(pcb);
+}
+
+//==========================================================================
+// Called by KCSwitch once it has switched away from an exited pcb
+//==========================================================================
+void FreeExitedPCB(PCB* pcb) {
+  pt_free(pcb->region1_pt);
+  FreeKernelStack(pcb->kstack_pfn);
+  queue_delete(pcb->children);
+  slab_free(&pcb_cache, pcb);
+}
+
+void FreeZombie(zombie_t* zombie) {
+  helper_retire_pid(zombie->pid);
+  slab_free(&zombie_cache, zombie);
+}
+
+//==========================================================================
+// Pool of whole kernel stacks. Exited processes return their stacks here
+// and Fork takes one back without touching the frame allocator; the idle
+// process tops the pool up to kstack_pool_min.
+//==========================================================================
+static unsigned int kstack_pool[KSTACK_POOL_MAX][KSTACK_NPAGES];
+static int          kstack_pool_len = 0;
+static int          kstack_pool_min = KSTACK_POOL_MIN;
+
+//==========================================================================
+// Allocate the KSTACK_NPAGES frames of a kernel stack, as one contiguous
+// buddy run when the zone has one, else as single frames
+//==========================================================================
+static int NewKernelStack(unsigned int *kstack_pfn) {
+
+  int pfn = buddy_alloc(buddy_order(KSTACK_NPAGES));
+  if (pfn >= 0) {
+    for (int i = 0; i < KSTACK_NPAGES; i++) {
+      kstack_pfn[i] = pfn + i;
+      frame_tag(pfn + i, FRAME_OWNER_KERNEL, FRAME_KERNEL_STACK);
+    }
+    return 0;
+  }
+
+  int frames[KSTACK_NPAGES];
+  if (alloc_frames(KSTACK_NPAGES, frames) < 0) {
+    TracePrintf(0, "AllocKernelStack: no frames for a kernel stack\n");
+    return ERROR;
+  }
+  for (int i = 0; i < KSTACK_NPAGES; i++) {
+    kstack_pfn[i] = frames[i];
+    frame_tag(frames[i], FRAME_OWNER_KERNEL, FRAME_KERNEL_STACK);
+  }
+  return 0;
+}
+
+//==========================================================================
+// Release a kernel stack to wherever NewKernelStack got it from
+//==========================================================================
+static void ReleaseKernelStack(unsigned int *kstack_pfn) {
+
+  if (buddy_owns(kstack_pfn[0])) {
+    for (int i = 0; i < KSTACK_NPAGES; i++) {
+      frame_tag(kstack_pfn[i], FRAME_OWNER_KERNEL, FRAME_BUDDY_FREE);
+    }
+    buddy_free(kstack_pfn[0], buddy_order(KSTACK_NPAGES));
+    return;
+  }
+  for (int i = 0; i < KSTACK_NPAGES; i++) {
+    free_frame_number(kstack_pfn[i]);
+  }
+}
+
+//==========================================================================
+// Hand out a kernel stack, from the pool when it has one
+//==========================================================================
+int AllocKernelStack(unsigned int *kstack_pfn) {
+
+  if (kstack_pool_len > 0) {
+    kstack_pool_len--;
+    memcpy(kstack_pfn, kstack_pool[kstack_pool_len], sizeof(kstack_pool[0]));
+    return 0;
+  }
+  return NewKernelStack(kstack_pfn);
+}
+
+//==========================================================================
+// Take back a kernel stack that is no longer running anything. The pool
+// keeps it unless it is full.
+//==========================================================================
+void FreeKernelStack(unsigned int *kstack_pfn) {
+
+  if (kstack_pool_len < KSTACK_POOL_MAX) {
+    for (int i = 0; i < KSTACK_NPAGES; i++) {
+      frame_tag(kstack_pfn[i], FRAME_OWNER_KERNEL, FRAME_KERNEL_STACK);
+    }
+    memcpy(kstack_pool[kstack_pool_len], kstack_pfn, sizeof(kstack_pool[0]));
+    kstack_pool_len++;
+    return;
+  }
+  ReleaseKernelStack(kstack_pfn);
+}
+
+//==========================================================================
+// Keep at least min stacks warm; stacks above the new minimum stay until
+// they are used. Returns ERROR if min is out of range.
+//==========================================================================
+int KernelStackPoolSetMin(int min) {
+
+  if (min < 0 || min > KSTACK_POOL_MAX) {
+    return ERROR;
+  }
+  kstack_pool_min = min;
+  return 0;
+}
+
+//==========================================================================
+// Top the pool up to its minimum, one stack per call, without pushing the
+// free count below the reserve a new process would need
+//==========================================================================
+void KernelStackPoolFill(void) {
+
+  if (kstack_pool_len >= kstack_pool_min ||
+      frames_available(FRAME_CLASS_PROCESS) < KSTACK_NPAGES) {
+    return;
+  }
+  if (NewKernelStack(kstack_pool[kstack_pool_len]) == 0) {
+    kstack_pool_len++;
+  }
+}
 
+int KernelStackPoolSize(void) {
+  return kstack_pool_len;
 }
@@ -6,6 +6,7 @@
 #include "hardware.h"
 #include "ykernel.h"
 #include "queue.h"      // for queue_t to track child PCBs
+#include "vm.h"         // for vpage_t
 
 /* Number of pages in the kernel stack */
 #define KSTACK_NPAGES \
@@ -27,6 +28,8 @@ typedef enum pcb_state {
 //==========================================================================
 typedef struct pcb {
     pte_t       *region1_pt;                /* Region 1 page table */
+    vpage_t      vpages[MAX_PT_LEN];        /* Software state of each region 1 page */
+    image_t     *image;                     /* Executable backing VPG_FILE pages */
     int          pid;                       /* From helper_new_pid() */
     UserContext  uctxt;                     /* Saved user-mode context */
     unsigned int kstack_pfn[KSTACK_NPAGES]; /* PFNs for the kernel stack */
@@ -46,6 +49,15 @@ typedef struct pcb {
     int kernel_read_buffer_size;
 } PCB;
 
+//==========================================================================
+// What is left of an exited process until its parent Waits for it
+//==========================================================================
+typedef struct zombie {
+    int          pid;
+    int          exit_status;
+    struct pcb  *parent;
+} zombie_t;
+
 //============================================
 // CP4:- Tracking queues for round-robin
 //============================================
@@ -65,8 +77,34 @@ PCB* CreatePCB(pte_t* user_page_table, UserContext* uctxt);
 //==============================================
 // CP4:- Initialize queues to track processes
 //==============================================
+#define PCB_PREALLOC 16
+
+void PCBCacheInit(void);
 void initQueues(void);
 void DeallocatePCB(PCB* pcb);
 
+//==========================================================================
+// Exit tears a process down at once: ExitPCB() frees its address space and
+// leaves a zombie_t for the parent; KCSwitch then calls FreeExitedPCB()
+// for the page table, kernel stack and PCB, once it no longer runs on them.
+//==========================================================================
+void ExitPCB(PCB* pcb, int status);
+void FreeExitedPCB(PCB* pcb);
+void FreeZombie(zombie_t* zombie);
+
+//==========================================================================
+// Kernel stack frames for a PCB. Freed stacks go to a pool of up to
+// KSTACK_POOL_MAX stacks that Fork draws from first; idle time keeps at
+// least the configured minimum (KSTACK_POOL_MIN by default) in it.
+//==========================================================================
+#define KSTACK_POOL_MAX  16
+#define KSTACK_POOL_MIN  4
+
+int AllocKernelStack(unsigned int *kstack_pfn);
+void FreeKernelStack(unsigned int *kstack_pfn);
+int KernelStackPoolSetMin(int min);
+void KernelStackPoolFill(void);
+int KernelStackPoolSize(void);
+
 #endif /* PROCESS_H */
                          
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ptpool.h"
+#include "kernel.h"
+#include "frame.h"
+#include "tlb.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Pool state: cleared tables are linked through their first entry
+//======================================================================
+static pte_t *free_tables = NULL;  // Cleared tables ready to hand out
+static int    num_free_tables = 0;
+static int    mapped_pages = 0;    // Window pages backed by a frame so far
+
+//======================================================================
+// Is pt one of the pool's tables (rather than a boot-time calloc)?
+//======================================================================
+static int in_window(pte_t *pt) {
+    unsigned int addr = (unsigned int)pt;
+    return addr >= (PT_POOL_BASE_VPN << PAGESHIFT) &&
+           addr <  (KMAP_BASE_VPN << PAGESHIFT);
+}
+
+//======================================================================
+// Back the next window page with a frame and carve it into tables
+// Returns 0 on success, ERROR if the window is full or memory is out
+//======================================================================
+static int pt_pool_grow(void) {
+
+    if (mapped_pages >= PT_POOL_NPAGES) {
+        TracePrintf(0, "pt_pool_grow: page table window is full\n");
+        return ERROR;
+    }
+
+    int pfn = get_free_frame();
+    if (pfn < 0) {
+        TracePrintf(0, "pt_pool_grow: no frame for page tables\n");
+        return ERROR;
+    }
+    frame_tag(pfn, FRAME_OWNER_KERNEL, FRAME_PAGE_TABLE);
+
+    int vpn = PT_POOL_BASE_VPN + mapped_pages++;
+    kernel_page_table[vpn].valid = 1;
+    kernel_page_table[vpn].prot  = PROT_READ | PROT_WRITE;
+    kernel_page_table[vpn].pfn   = pfn;
+    tlb_flush_page(vpn << PAGESHIFT, TLB_R_KERNEL);
+
+    char *page = (char *)(vpn << PAGESHIFT);
+    memset(page, 0, PAGESIZE);
+    for (int i = 0; i < (int)PT_PER_PAGE; i++) {
+        pte_t *pt = (pte_t *)(page + i * PT_BYTES);
+        *(pte_t **)pt = free_tables;
+        free_tables = pt;
+        num_free_tables++;
+    }
+    return 0;
+}
+
+//======================================================================
+// Take a cleared region-1 page table from the pool
+// Returns: the table, or NULL if none can be had
+//======================================================================
+pte_t *pt_alloc(void) {
+
+    if (free_tables == NULL && pt_pool_grow() < 0) {
+        return NULL;
+    }
+
+    pte_t *pt = free_tables;
+    free_tables = *(pte_t **)pt;
+    *(pte_t **)pt = NULL;           // the link was the only non-zero entry
+    num_free_tables--;
+    return pt;
+}
+
+//======================================================================
+// Return a table to the pool, cleared for its next user. The caller
+// has already released the frames it mapped.
+//======================================================================
+void pt_free(pte_t *pt) {
+
+    if (pt == NULL) {
+        return;
+    }
+    // The same address may come back for another process
+    tlb_forget_region1(pt);
+
+    if (!in_window(pt)) {
+        free(pt);
+        return;
+    }
+
+    memset(pt, 0, PT_BYTES);
+    *(pte_t **)pt = free_tables;
+    free_tables = pt;
+    num_free_tables++;
+}
+
+int pt_pool_free_count(void) {
+    return num_free_tables;
+}
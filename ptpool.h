@@ -0,0 +1,24 @@
+/* ptpool.h - Pool of region-1 page tables in dedicated frames */
+
+#ifndef _PTPOOL_H
+#define _PTPOOL_H
+
+#include "hardware.h"
+#include "yalnix.h"
+
+//==========================================================================
+// Region-1 page tables live in frames mapped at a fixed region-0 window
+// just below the kernel mapping window, PT_PER_PAGE tables per frame.
+// Frames are mapped on demand and never return to the kernel heap; freed
+// tables are cleared and kept for the next Fork.
+//==========================================================================
+#define PT_BYTES          (MAX_PT_LEN * sizeof(pte_t))
+#define PT_PER_PAGE       (PAGESIZE / PT_BYTES)
+#define PT_POOL_NPAGES    ((MAX_PROCS + PT_PER_PAGE - 1) / PT_PER_PAGE)
+#define PT_POOL_BASE_VPN  (KMAP_BASE_VPN - PT_POOL_NPAGES)
+
+pte_t *pt_alloc(void);
+void   pt_free(pte_t *pt);
+int    pt_pool_free_count(void);
+
+#endif /* _PTPOOL_H */
@@ -3,12 +3,27 @@
 #include "ykernel.h"
 #include "queue.h"
 #include "process.h"
+#include "slab.h"
+
+//=====================================================================
+// Slab caches for queues and their nodes
+//=====================================================================
+static slab_cache_t queue_cache;
+static slab_cache_t queue_node_cache;
+
+void queue_cache_init(void) {
+    if (slab_cache_init(&queue_cache, "queue", sizeof(queue_t), QUEUE_PREALLOC) < 0 ||
+        slab_cache_init(&queue_node_cache, "queue_node", sizeof(queue_node_t), QUEUE_NODE_PREALLOC) < 0) {
+        TracePrintf(0, "queue_cache_init: failed to set up queue caches\n");
+        Halt();
+    }
+}
 
 //=====================================================================
 // Define create_node function
 //=====================================================================
 static queue_node_t* create_node(void* item) {
-    queue_node_t* node = malloc(sizeof(queue_node_t));
+    queue_node_t* node = slab_alloc(&queue_node_cache);
     if (!node) return NULL;
     node->item = item;
     node->next = node->prev = NULL;
@@ -20,7 +35,7 @@ static queue_node_t* create_node(void* item) {
 //=====================================================================
 queue_t* queue_new(void) {
 
-    queue_t* queue = malloc(sizeof(queue_t));
+    queue_t* queue = slab_alloc(&queue_cache);
     if (queue == NULL) {
         TracePrintf(0, "Unable to allocate memory for queue\n");
         return NULL;
@@ -82,7 +97,7 @@ void* queue_get(queue_t* queue) {
         queue->head->prev = NULL;
     else
         queue->tail = NULL;
-    free(node);
+    slab_free(&queue_node_cache, node);
     queue->size--;
     return result;
 }
@@ -108,7 +123,7 @@ void queue_delete_node(queue_t* queue, void* item) {
             else queue->head = next;
             if (next) next->prev = prev;
             else queue->tail = prev;
-            free(current);
+            slab_free(&queue_node_cache, current);
             queue->size--;
             return;
         }
@@ -138,10 +153,10 @@ void queue_delete(queue_t* queue) {
     queue_node_t* current = queue->head;
     while (current) {
         queue_node_t* next = current->next;
-        free(current);
+        slab_free(&queue_node_cache, current);
         current = next;
     }
-    free(queue);
+    slab_free(&queue_cache, queue);
 }
 
 //=====================================================================
@@ -154,4 +169,27 @@ void queue_iterate(queue_t *queue, queue_callback_t cb, void *ctx, void* ctx2) {
         cb(cur->item, ctx, ctx2);
         cur = cur->next;
     }
-}
\ No newline at end of file
+}
+
+//=====================================================================
+// Define queue_delete_if function
+//      Unlink, in one pass, every item for which match(item, ctx) is
+//      nonzero. The item isn't touched again once match says so, so
+//      match may free it.
+//=====================================================================
+void queue_delete_if(queue_t *queue, queue_match_t match, void *ctx) {
+    if (!queue || !match) return;
+    queue_node_t *cur = queue->head;
+    while (cur) {
+        queue_node_t *next = cur->next;
+        if (match(cur->item, ctx)) {
+            if (cur->prev) cur->prev->next = next;
+            else queue->head = next;
+            if (next) next->prev = cur->prev;
+            else queue->tail = cur->prev;
+            slab_free(&queue_node_cache, cur);
+            queue->size--;
+        }
+        cur = next;
+    }
+}
@@ -18,6 +18,10 @@ typedef struct queue_node {
 typedef struct pcb PCB;
 typedef struct queue_t queue_t;
 
+#define QUEUE_PREALLOC       32
+#define QUEUE_NODE_PREALLOC  64
+
+void queue_cache_init(void);
 queue_t* queue_new(void);
 int queue_size(queue_t* queue);
 void queue_add(queue_t* queue, void* item);
@@ -28,5 +32,7 @@ int queue_find(queue_t* queue, void* item);
 void queue_delete(queue_t* queue);
 typedef void (*queue_callback_t)(void* item, void *ctx, void* ctx2);
 void queue_iterate(queue_t *queue, queue_callback_t cb, void *ctx, void* ctx2);
+typedef int (*queue_match_t)(void* item, void *ctx);
+void queue_delete_if(queue_t *queue, queue_match_t match, void *ctx);
 
 #endif // QUEUE_H
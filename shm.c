@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <limits.h>
+#include "shm.h"
+#include "process.h"
+#include "queue.h"
+#include "frame.h"
+#include "tlb.h"
+#include "vm.h"
+#include "kernel.h"
+
+//=====================================================================
+// Define shm_t and the per-process attachment record
+//=====================================================================
+typedef struct shm {
+    int shm_id;
+    int npages;
+    int* pfn;               // frames of the segment, one reference each
+    queue_t* attached;      // shm_attach_t of every process mapping it
+} shm_t;
+
+typedef struct shm_attach {
+    PCB* pcb;
+    int base;               // first region 1 page of the mapping
+} shm_attach_t;
+
+static queue_t* shm_queue = NULL;
+static int next_shm_id = 1;
+
+//=====================================================================
+// Define lookup callbacks
+//=====================================================================
+static void find_shm_cb(void *item, void *ctx, void *ctx2) {
+    shm_t *s = (shm_t *)item;
+    int target_id = *(int *)ctx;
+    shm_t **out_ptr = (shm_t **)ctx2;
+
+    if (s->shm_id == target_id && *out_ptr == NULL) {
+        *out_ptr = s;
+    }
+}
+
+static void find_attach_cb(void *item, void *ctx, void *ctx2) {
+    shm_attach_t *a = (shm_attach_t *)item;
+    shm_attach_t **out_ptr = (shm_attach_t **)ctx2;
+
+    if (a->pcb == (PCB *)ctx && *out_ptr == NULL) {
+        *out_ptr = a;
+    }
+}
+
+static shm_attach_t* find_attach(shm_t* shm, PCB* pcb) {
+    shm_attach_t* found = NULL;
+    queue_iterate(shm->attached, find_attach_cb, pcb, &found);
+    return found;
+}
+
+//=====================================================================
+// Map shm at base in pcb and record the attachment
+//=====================================================================
+static int attach(shm_t* shm, PCB* pcb, int base) {
+    shm_attach_t* a = malloc(sizeof(shm_attach_t));
+    if (a == NULL) {
+        return ERROR;
+    }
+    a->pcb = pcb;
+    a->base = base;
+
+    for (int i = 0; i < shm->npages; i++) {
+        frame_ref(shm->pfn[i]);
+        pcb->region1_pt[base + i].valid = 1;
+        pcb->region1_pt[base + i].prot = PROT_READ | PROT_WRITE;
+        pcb->region1_pt[base + i].pfn = shm->pfn[i];
+        pcb->vpages[base + i].flags = VPG_SHARED;
+    }
+    queue_add(shm->attached, a);
+    return 0;
+}
+
+//=====================================================================
+// Define ShmCreate function
+//      Returns the address of the new segment in the caller, or ERROR
+//=====================================================================
+int ShmCreate(int *shm_idp, int npages) {
+
+    if (shm_idp == NULL || npages <= 0 || npages > SHM_MAX_PAGES || next_shm_id == INT_MAX) {
+        TracePrintf(0, "ShmCreate: invalid arguments\n");
+        return ERROR;
+    }
+    if (shm_queue == NULL && (shm_queue = queue_new()) == NULL) {
+        return ERROR;
+    }
+
+    int base = vm_find_gap(currentPCB, npages, SHM_STACK_GAP);
+    if (base < 0) {
+        TracePrintf(0, "ShmCreate: no room for %d pages in process %d\n", npages, currentPCB->pid);
+        return ERROR;
+    }
+    if (vm_reclaim(FRAME_CLASS_USER, npages) < 0) {
+        TracePrintf(0, "ShmCreate: not enough free frames for %d pages\n", npages);
+        return ERROR;
+    }
+
+    shm_t* shm = malloc(sizeof(shm_t));
+    int* pfn = malloc(npages * sizeof(int));
+    queue_t* attached = queue_new();
+    if (shm == NULL || pfn == NULL || attached == NULL) {
+        free(shm);
+        free(pfn);
+        if (attached != NULL) {
+            queue_delete(attached);
+        }
+        return ERROR;
+    }
+
+    for (int i = 0; i < npages; i++) {
+        pfn[i] = get_zeroed_frame();
+        frame_tag(pfn[i], FRAME_OWNER_KERNEL, FRAME_USER_SHARED);
+    }
+    shm->shm_id = next_shm_id++;
+    shm->npages = npages;
+    shm->pfn = pfn;
+    shm->attached = attached;
+
+    if (attach(shm, currentPCB, base) < 0) {
+        free_frames(pfn, npages);
+        queue_delete(attached);
+        free(pfn);
+        free(shm);
+        return ERROR;
+    }
+    queue_add(shm_queue, shm);
+    *shm_idp = shm->shm_id;
+
+    TracePrintf(1, "ShmCreate: segment %d, %d pages at page %d of process %d\n",
+                shm->shm_id, npages, base, currentPCB->pid);
+    return VMEM_1_BASE + (base << PAGESHIFT);
+}
+
+//=====================================================================
+// Define ShmAttach function
+//      Returns the address of the segment in the caller, or ERROR
+//=====================================================================
+int ShmAttach(int shm_id) {
+
+    shm_t* shm = NULL;
+    if (shm_queue != NULL) {
+        queue_iterate(shm_queue, find_shm_cb, &shm_id, &shm);
+    }
+    if (shm == NULL) {
+        TracePrintf(0, "ShmAttach: segment %d not found\n", shm_id);
+        return ERROR;
+    }
+
+    // attaching twice hands back the existing mapping
+    shm_attach_t* a = find_attach(shm, currentPCB);
+    if (a != NULL) {
+        return VMEM_1_BASE + (a->base << PAGESHIFT);
+    }
+
+    int base = vm_find_gap(currentPCB, shm->npages, SHM_STACK_GAP);
+    if (base < 0 || attach(shm, currentPCB, base) < 0) {
+        TracePrintf(0, "ShmAttach: can't map segment %d in process %d\n", shm_id, currentPCB->pid);
+        return ERROR;
+    }
+    return VMEM_1_BASE + (base << PAGESHIFT);
+}
+
+//=====================================================================
+// Define ShmFork function
+//      The child already has the parent's page table entries; record it
+//      as attached wherever the parent is
+//=====================================================================
+static void fork_cb(void *item, void *ctx, void *ctx2) {
+    shm_t* shm = (shm_t *)item;
+    shm_attach_t* a = find_attach(shm, (PCB *)ctx);
+
+    if (a != NULL) {
+        shm_attach_t* c = malloc(sizeof(shm_attach_t));
+        if (c != NULL) {
+            c->pcb = (PCB *)ctx2;
+            c->base = a->base;
+            queue_add(shm->attached, c);
+        }
+    }
+}
+
+void ShmFork(PCB *parent, PCB *child) {
+    if (shm_queue != NULL) {
+        queue_iterate(shm_queue, fork_cb, parent, child);
+    }
+}
+
+//=====================================================================
+// Unmap shm from pcb and drop the attachment a; the last one to go
+// frees the segment
+//=====================================================================
+static void detach(shm_t* shm, PCB* pcb, shm_attach_t* a) {
+
+    for (int i = 0; i < shm->npages; i++) {
+        int vpn = a->base + i;
+        if (pcb->region1_pt[vpn].valid) {
+            free_frame_number(pcb->region1_pt[vpn].pfn);
+            pcb->region1_pt[vpn].valid = 0;
+            if (pcb == currentPCB) {
+                tlb_flush_page(VMEM_1_BASE + (vpn << PAGESHIFT), TLB_R_UNMAP);
+            }
+        }
+        pcb->vpages[vpn].flags = 0;
+    }
+    queue_delete_node(shm->attached, a);
+    free(a);
+
+    if (queue_is_empty(shm->attached)) {
+        TracePrintf(1, "detach: freeing segment %d\n", shm->shm_id);
+        queue_delete_node(shm_queue, shm);
+        free_frames(shm->pfn, shm->npages);
+        queue_delete(shm->attached);
+        free(shm->pfn);
+        free(shm);
+    }
+}
+
+//=====================================================================
+// Define ShmDetach function
+//      Unmap segment shm_id from the caller
+//      Returns 0, or ERROR if the caller doesn't map it
+//=====================================================================
+int ShmDetach(int shm_id) {
+
+    shm_t* shm = NULL;
+    if (shm_queue != NULL) {
+        queue_iterate(shm_queue, find_shm_cb, &shm_id, &shm);
+    }
+    shm_attach_t* a = (shm != NULL) ? find_attach(shm, currentPCB) : NULL;
+    if (a == NULL) {
+        TracePrintf(0, "ShmDetach: process %d doesn't map segment %d\n", currentPCB->pid, shm_id);
+        return ERROR;
+    }
+    detach(shm, currentPCB, a);
+    return 0;
+}
+
+//=====================================================================
+// Define ShmDetachAll function
+//      Unmap every segment from pcb; a segment nobody maps is freed
+//=====================================================================
+static void collect_cb(void *item, void *ctx, void *ctx2) {
+    if (find_attach((shm_t *)item, (PCB *)ctx) != NULL) {
+        queue_add((queue_t *)ctx2, item);
+    }
+}
+
+void ShmDetachAll(PCB *pcb) {
+
+    if (shm_queue == NULL || queue_is_empty(shm_queue)) {
+        return;
+    }
+
+    // collect first; the segments queue changes as they are freed
+    queue_t* mine = queue_new();
+    if (mine == NULL) {
+        return;
+    }
+    queue_iterate(shm_queue, collect_cb, pcb, mine);
+
+    shm_t* shm;
+    while ((shm = queue_get(mine)) != NULL) {
+        detach(shm, pcb, find_attach(shm, pcb));
+    }
+    queue_delete(mine);
+}
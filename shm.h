@@ -0,0 +1,23 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "process.h"
+#include "queue.h"
+
+//=====================================================================
+// Shared memory segments: npages frames mapped read/write into region 1
+// of every attached process. Fork attaches the child too; ShmDetach,
+// Exec and Exit detach, and the last process to detach frees the frames.
+//=====================================================================
+typedef struct shm shm_t;
+
+#define SHM_MAX_PAGES  32   // largest segment
+#define SHM_STACK_GAP  8    // pages left below the stack for it to grow
+
+int ShmCreate(int *shm_idp, int npages);
+int ShmAttach(int shm_id);
+int ShmDetach(int shm_id);
+void ShmFork(PCB *parent, PCB *child);
+void ShmDetachAll(PCB *pcb);
+
+#endif // SHM_H
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include "slab.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Every initialized cache, for the stats dump
+//======================================================================
+static slab_cache_t *caches[SLAB_MAX_CACHES];
+static int num_caches = 0;
+
+//======================================================================
+// Carve one new slab into the cache's free list
+// Returns 0 on success, ERROR if the kernel heap is exhausted
+//======================================================================
+static int slab_grow(slab_cache_t *cache) {
+
+    char *slab = malloc(cache->obj_size * SLAB_OBJS_PER_SLAB);
+    if (slab == NULL) {
+        TracePrintf(0, "slab_grow: no memory for a %s slab\n", cache->name);
+        return ERROR;
+    }
+
+    for (int i = 0; i < SLAB_OBJS_PER_SLAB; i++) {
+        void **obj = (void **)(slab + i * cache->obj_size);
+        *obj = cache->free_list;
+        cache->free_list = obj;
+    }
+    cache->num_free  += SLAB_OBJS_PER_SLAB;
+    cache->num_total += SLAB_OBJS_PER_SLAB;
+    return 0;
+}
+
+//======================================================================
+// Set up a cache of obj_size objects with at least prealloc ready
+// Returns 0 on success, ERROR on failure
+//======================================================================
+int slab_cache_init(slab_cache_t *cache, const char *name, int obj_size, int prealloc) {
+
+    if (cache == NULL || obj_size <= 0 || num_caches >= SLAB_MAX_CACHES) {
+        return ERROR;
+    }
+
+    // Each free object must be able to hold the free-list link
+    if (obj_size < (int)sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    cache->name      = name;
+    cache->obj_size  = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    cache->free_list = NULL;
+    cache->num_free  = 0;
+    cache->num_total = 0;
+    cache->hits      = 0;
+    cache->misses    = 0;
+
+    while (cache->num_free < prealloc) {
+        if (slab_grow(cache) < 0) {
+            return ERROR;
+        }
+    }
+
+    caches[num_caches++] = cache;
+    return 0;
+}
+
+//======================================================================
+// Take an object from the cache, growing it by a slab on a miss
+// Returns: the object, or NULL if the kernel heap is exhausted
+//======================================================================
+void *slab_alloc(slab_cache_t *cache) {
+
+    if (cache->free_list != NULL) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+        if (slab_grow(cache) < 0) {
+            return NULL;
+        }
+    }
+
+    void **obj = cache->free_list;
+    cache->free_list = *obj;
+    cache->num_free--;
+    return obj;
+}
+
+//======================================================================
+// Return an object to its cache
+//======================================================================
+void slab_free(slab_cache_t *cache, void *obj) {
+
+    if (obj == NULL) {
+        return;
+    }
+    *(void **)obj = cache->free_list;
+    cache->free_list = obj;
+    cache->num_free++;
+}
+
+//======================================================================
+// Print per-cache counters at the given trace level
+//======================================================================
+void slab_dump_stats(int level) {
+    for (int i = 0; i < num_caches; i++) {
+        slab_cache_t *c = caches[i];
+        TracePrintf(level, "slab %-10s size %4d: %d/%d free, %d hits, %d misses\n",
+                    c->name, c->obj_size, c->num_free, c->num_total, c->hits, c->misses);
+    }
+}
@@ -0,0 +1,29 @@
+/* slab.h - Typed object caches for hot kernel allocations */
+
+#ifndef _SLAB_H
+#define _SLAB_H
+
+//==========================================================================
+// A cache hands out fixed-size objects from a free list. An empty free
+// list is refilled with one malloc'ed slab of SLAB_OBJS_PER_SLAB objects,
+// and freed objects go back on the list, never to malloc.
+//==========================================================================
+#define SLAB_OBJS_PER_SLAB  16
+#define SLAB_MAX_CACHES     16
+
+typedef struct slab_cache {
+    const char *name;
+    int         obj_size;
+    void       *free_list;      /* Free objects, linked through their first word */
+    int         num_free;       /* Objects on the free list */
+    int         num_total;      /* Objects carved from slabs so far */
+    int         hits;           /* Allocations served from the free list */
+    int         misses;         /* Allocations that had to grow the cache */
+} slab_cache_t;
+
+int   slab_cache_init(slab_cache_t *cache, const char *name, int obj_size, int prealloc);
+void *slab_alloc(slab_cache_t *cache);
+void  slab_free(slab_cache_t *cache, void *obj);
+void  slab_dump_stats(int level);
+
+#endif /* _SLAB_H */
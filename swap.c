@@ -0,0 +1,220 @@
+#include "swap.h"
+#include "frame.h"
+#include "vm.h"
+#include "tlb.h"
+#include "disk.h"
+#include "process.h"
+#include "kernel.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Slot bitmap and clock state
+//======================================================================
+static unsigned char slot_map[(SWAP_NSLOTS + 7) / 8];
+static int slots_free = SWAP_NSLOTS;
+static int hand_pid = 0;        // Clock hand: the victim process and page
+static int hand_vpn = 0;        // it points at
+
+static int alloc_slot(void) {
+    for (int slot = 0; slot < SWAP_NSLOTS; slot++) {
+        if (!(slot_map[slot / 8] & (1 << (slot % 8)))) {
+            slot_map[slot / 8] |= 1 << (slot % 8);
+            slots_free--;
+            return slot;
+        }
+    }
+    return ERROR;
+}
+
+void swap_release(int slot) {
+    if (slot < 0 || slot >= SWAP_NSLOTS || !(slot_map[slot / 8] & (1 << (slot % 8)))) {
+        TracePrintf(0, "swap_release: slot %d is not in use\n", slot);
+        return;
+    }
+    slot_map[slot / 8] &= ~(1 << (slot % 8));
+    slots_free++;
+}
+
+int swap_free_slots(void) {
+    return slots_free;
+}
+
+//======================================================================
+// Read a slot back into frame pfn and free the slot; the caller sleeps
+// until the read is done
+// Returns 0, or ERROR if the caller can't wait for the disk
+//======================================================================
+int swap_read(int slot, int pfn) {
+    if (disk_frame_io(DISK_READ, SWAP_FIRST_SECTOR + slot * SWAP_SECTORS_PER_PAGE,
+                      PAGESIZE, pfn) < 0) {
+        return ERROR;
+    }
+    swap_release(slot);
+    return 0;
+}
+
+//======================================================================
+// Can page vpn of pcb go to disk? Shared, copy-on-write, pinned and
+// disk-mapped pages stay in memory.
+//======================================================================
+static int swappable(PCB *pcb, int vpn) {
+    pte_t *pte = &pcb->region1_pt[vpn];
+    return pte->valid &&
+           !(pcb->vpages[vpn].flags & (VPG_COW | VPG_SHARED | VPG_PIN | VPG_DMAP)) &&
+           frame_refcount(pte->pfn) == 1;
+}
+
+//======================================================================
+// Write page vpn of pcb to a free slot and release its frame. The page
+// keeps its protection and use in its vpage_t for the fault that brings
+// it back. It is unmapped before the write starts and its frame freed
+// only once the write is done; the caller sleeps in between, and pcb
+// may be gone by the time it wakes.
+// Returns 0 on success, ERROR if the page can't be swapped, swap is full
+// or the caller can't wait for the disk
+//======================================================================
+int swap_out_page(PCB *pcb, int vpn) {
+
+    if (!swappable(pcb, vpn)) {
+        return ERROR;
+    }
+    int slot = alloc_slot();
+    if (slot < 0) {
+        return ERROR;
+    }
+
+    pte_t   *pte = &pcb->region1_pt[vpn];
+    vpage_t *vp  = &pcb->vpages[vpn];
+    int      pfn = pte->pfn;
+    vpage_t  old = *vp;
+
+    vp->prot   = pte->prot;
+    vp->use    = frame_desc(pfn)->use;
+    vp->offset = slot;
+    vp->flags  = (vp->flags & ~VPG_REF) | VPG_SWAP;
+    pte->valid = 0;
+    if (pcb == currentPCB) {
+        tlb_flush_page(VMEM_1_BASE + (vpn << PAGESHIFT), TLB_R_UNMAP);
+    }
+
+    if (disk_frame_io(DISK_WRITE, SWAP_FIRST_SECTOR + slot * SWAP_SECTORS_PER_PAGE,
+                      PAGESIZE, pfn) < 0) {
+        // Nothing slept: pcb is still there to put back as it was
+        *vp = old;
+        pte->valid = 1;
+        swap_release(slot);
+        return ERROR;
+    }
+    // pcb may have exited, run Exec or faulted the page back in while we
+    // slept; only the frame is still ours, so nothing else is touched
+    free_frame_number(pfn);
+    return 0;
+}
+
+//======================================================================
+// Collect the processes whose pages may be taken
+//======================================================================
+static void collect_victim_cb(void *item, void *ctx, void *ctx2) {
+    PCB  *pcb     = (PCB *)item;
+    PCB **victims = (PCB **)ctx;
+    int  *n       = (int *)ctx2;
+
+    if (pcb == currentPCB || pcb == idlePCB || *n >= MAX_PROCS) {
+        return;
+    }
+    if (pcb->num_delay == 0 || pcb->num_delay >= SWAP_MIN_DELAY) {
+        victims[(*n)++] = pcb;
+    }
+}
+
+static int collect_victims(PCB **victims) {
+    int n = 0;
+    queue_iterate(blocked_processes, collect_victim_cb, victims, &n);
+    queue_iterate(waiting_parent_processes, collect_victim_cb, victims, &n);
+    return n;
+}
+
+//======================================================================
+// Victim under the clock hand: the process it was on if that is still a
+// victim, else the one with the next higher pid, wrapping to the lowest.
+// The hand names a pid, so a victim that exits or wakes up while a
+// page-out sleeps just drops out of the sweep.
+// Returns: that victim, or NULL if there is none
+//======================================================================
+static PCB *hand_victim(PCB **victims, int nvictims) {
+    PCB *next   = NULL;
+    PCB *lowest = NULL;
+
+    for (int i = 0; i < nvictims; i++) {
+        PCB *pcb = victims[i];
+        if (pcb->pid == hand_pid) {
+            return pcb;
+        }
+        if (pcb->pid > hand_pid && (next == NULL || pcb->pid < next->pid)) {
+            next = pcb;
+        }
+        if (lowest == NULL || pcb->pid < lowest->pid) {
+            lowest = pcb;
+        }
+    }
+    if (next == NULL) {
+        next = lowest;
+    }
+    if (next != NULL) {
+        hand_pid = next->pid;
+        hand_vpn = 0;
+    }
+    return next;
+}
+
+static void hand_advance(void) {
+    if (++hand_vpn == MAX_PT_LEN) {
+        hand_pid++;
+        hand_vpn = 0;
+    }
+}
+
+//======================================================================
+// Page out up to nframes pages of blocked processes. The hand sweeps
+// every victim page at most twice: once to clear reference bits, once
+// more to take the pages that weren't used since. Each page-out sleeps
+// on the disk, so the victims are collected again after it and the
+// hand finds its process by pid.
+// Returns: the number of frames freed
+//======================================================================
+int swap_reclaim(int nframes) {
+
+    PCB *victims[MAX_PROCS];
+    int  nvictims = collect_victims(victims);
+    if (nvictims == 0) {
+        return 0;
+    }
+
+    int freed  = 0;
+    int budget = 2 * nvictims * MAX_PT_LEN;
+    while (freed < nframes && budget-- > 0 && slots_free > 0) {
+        PCB *pcb = hand_victim(victims, nvictims);
+        if (pcb == NULL) {
+            break;
+        }
+        int vpn = hand_vpn;
+        hand_advance();
+
+        if (!swappable(pcb, vpn)) {
+            continue;
+        }
+        if (pcb->vpages[vpn].flags & VPG_REF) {
+            pcb->vpages[vpn].flags &= ~VPG_REF;
+            continue;
+        }
+        if (swap_out_page(pcb, vpn) == 0) {
+            freed++;
+            nvictims = collect_victims(victims);
+        }
+    }
+
+    TracePrintf(1, "swap_reclaim: freed %d of %d frames, %d slots left\n", freed, nframes, slots_free);
+    return freed;
+}
@@ -0,0 +1,34 @@
+/* swap.h - Paging region-1 pages out to the DISK device */
+
+#ifndef _SWAP_H
+#define _SWAP_H
+
+#include "hardware.h"
+#include "yalnix.h"
+
+struct pcb;
+
+//==========================================================================
+// The disk is split in two: the sectors below SWAP_FIRST_SECTOR can be
+// mapped with DiskMap, and the rest is the swap area, SWAP_PERCENT of the
+// disk's whole pages, one slot per page, tracked by a bitmap. Build with
+// -DSWAP_PERCENT=n to move the split. Victims are region-1 pages of
+// processes that are blocked, or delayed for at least SWAP_MIN_DELAY more
+// ticks, chosen by a clock hand that gives recently faulted-in pages
+// (VPG_REF) a second chance. Only private, unpinned pages are swapped.
+//==========================================================================
+#ifndef SWAP_PERCENT
+#define SWAP_PERCENT           50
+#endif
+#define SWAP_SECTORS_PER_PAGE  (PAGESIZE / SECTORSIZE)
+#define SWAP_NSLOTS            ((NUMSECTORS / SWAP_SECTORS_PER_PAGE) * SWAP_PERCENT / 100)
+#define SWAP_FIRST_SECTOR      (NUMSECTORS - SWAP_NSLOTS * SWAP_SECTORS_PER_PAGE)
+#define SWAP_MIN_DELAY         4
+
+int  swap_out_page(struct pcb *pcb, int vpn);
+int  swap_read(int slot, int pfn);
+void swap_release(int slot);
+int  swap_reclaim(int nframes);
+int  swap_free_slots(void);
+
+#endif /* _SWAP_H */
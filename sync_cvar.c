@@ -3,6 +3,7 @@
 #include "sync_cvar.h"
 #include "sync_lock.h"
 #include <limits.h>
+#include "slab.h"
 
 //=====================================================================
 // Define cvar_t structure
@@ -23,6 +24,18 @@ static const int LOCK_MAX  = INT_MAX / 3;
 //=====================================================================
 static int next_cvar_id = LOCK_MAX + 1;
 
+//=====================================================================
+// Define the cvar slab cache
+//=====================================================================
+static slab_cache_t cvar_cache;
+
+void CvarCacheInit(void){
+    if (slab_cache_init(&cvar_cache, "cvar", sizeof(cvar_t), CVAR_PREALLOC) < 0){
+        TracePrintf(0, "CvarCacheInit: failed to set up cvar cache\n");
+        Halt();
+    }
+}
+
 //=====================================================================
 // Define CvarInit function
 //=====================================================================
@@ -40,7 +53,7 @@ int CvarInit(int * cvar_idp){
     }
 
     // allocate memory for the new_cvar
-    cvar_t* new_cvar = malloc(sizeof(cvar_t));
+    cvar_t* new_cvar = slab_alloc(&cvar_cache);
     if (new_cvar == NULL){
         TracePrintf(0, "CvarInit: Failed to allocate memory for cvar\n");
         return ERROR;
@@ -258,10 +271,10 @@ int Reclaim_cvar(int cvar_id){
     queue_delete_node(cvar_queue, found_cvar);
 
     // free the cvar_waiting_processes
-    free(found_cvar->cvar_waiting_processes);
+    queue_delete(found_cvar->cvar_waiting_processes);
 
     // free the cvar
-    free(found_cvar);
+    slab_free(&cvar_cache, found_cvar);
 
     // print the cvar reclaimed
     TracePrintf(0, "CvarInit: Cvar reclaimed\n");
@@ -11,7 +11,10 @@
 typedef struct cvar cvar_t;
 typedef struct lock lock_t;
 
+#define CVAR_PREALLOC 16
+
 // Function declarations
+void CvarCacheInit(void);
 int CvarInit(int *cvar_idp);
 int CvarSignal(int cvar_id);
 int CvarBroadcast(int cvar_id);
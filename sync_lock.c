@@ -3,6 +3,7 @@
 #include "sync_lock.h"
 #include "sync_cvar.h"
 #include <limits.h>
+#include "slab.h"
 
 //=====================================================================
 // Define lock_t structure
@@ -20,6 +21,18 @@ typedef struct lock {
 static const int LOCK_MAX  = INT_MAX / 3;
 static int next_lock_id = 1;
 
+//=====================================================================
+// Define the lock slab cache
+//=====================================================================
+static slab_cache_t lock_cache;
+
+void LockCacheInit(void){
+    if (slab_cache_init(&lock_cache, "lock", sizeof(lock_t), LOCK_PREALLOC) < 0){
+        TracePrintf(0, "LockCacheInit: failed to set up lock cache\n");
+        Halt();
+    }
+}
+
 //=====================================================================
 // Define LockInit function
 //=====================================================================
@@ -37,7 +50,7 @@ int LockInit(int *lock_idp){
     }
 
     // allocate memory for the new_lock
-    lock_t* new_lock = malloc(sizeof(lock_t));
+    lock_t* new_lock = slab_alloc(&lock_cache);
     if (new_lock == NULL){
         return ERROR;
     }
@@ -246,10 +259,10 @@ int Reclaim_lock(int lock_id){
     queue_delete_node(locks_queue, found_lock);
 
     // free the lock_waiting_processes
-    free(found_lock->lock_waiting_processes);
+    queue_delete(found_lock->lock_waiting_processes);
 
     // free the lock
-    free(found_lock);
+    slab_free(&lock_cache, found_lock);
     TracePrintf(0, "LockInit: Lock reclaimed\n");
 
     return 0;
@@ -9,7 +9,10 @@
 typedef struct lock lock_t;
 typedef struct cvar cvar_t;
 
+#define LOCK_PREALLOC 16
+
 // Lock functions
+void LockCacheInit(void);
 int LockInit(int *lock_idp);
 int Acquire(int lock_id);
 int Release(int lock_id);
@@ -9,6 +9,13 @@
 #include "sync_lock.h"
 #include "sync_cvar.h"
 #include "ipc.h"
+#include "ptpool.h"
+#include "vm.h"
+#include "shm.h"
+#include "diskmap.h"
+#include "tlb.h"
+#include "image.h"
+#include "ksm.h"
 
 
 //=========================================================================
@@ -24,7 +31,7 @@ int user_GetPid(void){
 //=========================================================================
 int user_Brk(void *addr){
   TracePrintf(0, "s_Brk called with addr: %p\n", addr);
-  if (addr == NULL || currentPCB == NULL){ 
+  if (addr == NULL || currentPCB == NULL || currentPCB->brk == NULL){ 
     TracePrintf(0, "s_Brk: Invalid address or current PCB is NULL.\n");
     return ERROR;
   }
@@ -38,79 +45,52 @@ int user_Brk(void *addr){
     return ERROR;
   }
 
-  // get the number of pages in region 1
-  int region1_pages = VMEM_1_BASE >> PAGESHIFT;
-  int addr_page = (converted_addr >> PAGESHIFT) - region1_pages;
-  int curr_brk;
+  // the heap covers every page below the (rounded up) break
+  int new_top = (UP_TO_PAGE(converted_addr) - VMEM_1_BASE) >> PAGESHIFT;
+  int old_top = (UP_TO_PAGE((unsigned int)currentPCB->brk) - VMEM_1_BASE) >> PAGESHIFT;
 
-  // check if the currentPCB's break is NULL
-  if (currentPCB->brk == NULL){
-    TracePrintf(0, "s_Brk: Initializing break for process %d.\n", currentPCB->pid);
-
-    // find the first invalid page in the currentPCB's region1_pt
-    for (int i = 0; i < region1_pages; i++){
-      if (currentPCB->region1_pt[i].valid == 0){
-        curr_brk = i;
-        break;
-      }
+  if (old_top < new_top){
+    // leave at least one page between the heap and the stack
+    int stack_page = ((unsigned int)currentPCB->uctxt.sp - VMEM_1_BASE) >> PAGESHIFT;
+    if (new_top >= stack_page){
+      TracePrintf(0, "s_Brk: New break %p for process %d runs into the stack.\n", addr, currentPCB->pid);
+      return ERROR;
     }
-    TracePrintf(0, "s_Brk: Current break for process %d is at page %d.\n", currentPCB->pid, curr_brk);
-
-    // allocate frames for the new pages
-    for (int i = curr_brk; i < addr_page; i++){
-      int index;
-      if ((index = get_free_frame()) < 0){
-        TracePrintf(0, "s_Brk: No free frames available for process %d.\n", currentPCB->pid);
-        return ERROR; // No free frames available
+    for (int i = old_top; i < new_top; i++){
+      if (currentPCB->region1_pt[i].valid || currentPCB->vpages[i].flags != 0){
+        TracePrintf(0, "s_Brk: Page %d of process %d is already in use.\n", i, currentPCB->pid);
+        return ERROR;
       }
-      currentPCB->region1_pt[i].valid = 1;
-      currentPCB->region1_pt[i].prot = PROT_READ | PROT_WRITE;
-      currentPCB->region1_pt[i].pfn = index;
     }
 
-    // set the currentPCB's break to the converted_addr
-    currentPCB->brk = (void *)converted_addr;
-    TracePrintf(0, "Process %d set break to %p at page %d.\n", currentPCB->pid, currentPCB->brk, addr_page);
-    return 0;
-  } 
-
-  // get the current break page
-  curr_brk = ((unsigned int)currentPCB->brk >> PAGESHIFT) - region1_pages;
-  if (curr_brk < addr_page){
-    TracePrintf(0, "s_Brk: Current break for process %d is lower than the new break at %p.\n", currentPCB->pid, currentPCB->brk);
-
-    // allocate frames for the new pages
-    for (int i = curr_brk; i < addr_page; i++){
-      int index;
-      if ((index = get_free_frame()) < 0){
-        TracePrintf(0, "s_Brk: No free frames available for process %d.\n", currentPCB->pid);
-        return ERROR; // No free frames available
+    // only reserve the range; each page gets a zeroed frame on first touch
+    vm_set_backing(currentPCB, old_top, new_top, VPG_ZERO, PROT_READ | PROT_WRITE,
+                   FRAME_USER_HEAP, 0, 0);
+  } else if (old_top > new_top){
+    // the break can't drop below the end of the program's data
+    for (int i = new_top; i < old_top; i++){
+      if (currentPCB->vpages[i].use != FRAME_USER_HEAP){
+        TracePrintf(0, "s_Brk: New break %p for process %d is below the heap.\n", addr, currentPCB->pid);
+        return ERROR;
       }
-      currentPCB->region1_pt[i].valid = 1;
-      currentPCB->region1_pt[i].prot = PROT_READ | PROT_WRITE;
-      currentPCB->region1_pt[i].pfn = index;
     }
-  } else if (curr_brk > addr_page){
-    TracePrintf(0, "s_Brk: Current break for process %d is higher than the new break at %p.\n", currentPCB->pid, currentPCB->brk);
-
-    // free the frames for the old pages
-    for (int i = curr_brk-1; i >= addr_page; i--){
-      currentPCB->region1_pt[i].valid = 0;
-      free_frame_number(currentPCB->region1_pt[i].pfn);
-      WriteRegister(REG_TLB_FLUSH, (i << PAGESHIFT) + VMEM_0_SIZE);
+
+    // free the frames of the pages that were touched, forget the rest
+    for (int i = new_top; i < old_top; i++){
+      if (currentPCB->region1_pt[i].valid){
+        free_frame_number(currentPCB->region1_pt[i].pfn);
+        currentPCB->region1_pt[i].valid = 0;
+        tlb_flush_page((i << PAGESHIFT) + VMEM_1_BASE, TLB_R_UNMAP);
+      }
     }
-  } else{
-    TracePrintf(0, "s_Brk: Current break for process %d is at the same page as the new break at %p.\n", currentPCB->pid, currentPCB->brk);
-    return ERROR;
+    vm_clear_range(currentPCB, new_top, old_top);
   }
 
   // set the currentPCB's break to the converted_addr
   currentPCB->brk = (void *)converted_addr;
-  TracePrintf(0, "Process %d set break to %p at page %d.\n", currentPCB->pid, currentPCB->brk, addr_page);
+  TracePrintf(0, "Process %d set break to %p, heap ends at page %d.\n", currentPCB->pid, currentPCB->brk, new_top);
 
   return 0;
-
-
 }
 
 //=========================================================================
@@ -191,69 +171,39 @@ int user_Fork(UserContext *uctxt) {
     PCB *parent = currentPCB;
     
     // Allocate new page table for child
-    pte_t *child_pt = calloc(MAX_PT_LEN, sizeof(pte_t));
+    pte_t *child_pt = pt_alloc();
     if (child_pt == NULL) {
         TracePrintf(0, "s_Fork: Failed to allocate child page table\n");
         return ERROR;
     }
 
-    // Copy each valid region-1 page from parent to child
-    for (int vpn = 0; vpn < MAX_PT_LEN; vpn++) {
-        if (parent->region1_pt[vpn].valid == 0) {
-            continue;
-        }
-
-        // Get a free physical frame for the child's page
-        int child_pfn = get_free_frame();
-        if (child_pfn < 0) {
-            TracePrintf(0, "s_Fork: No free frames available\n");
-            // Roll back: free all allocated frames
-            for (int j = 0; j < vpn; j++) {
-                if (child_pt[j].valid) {
-                    free_frame_number(child_pt[j].pfn);
-                }
-            }
-            free(child_pt);
-            return ERROR;
-        }
-
-        // Set up child's page table entry
-        child_pt[vpn].pfn = child_pfn;
-        child_pt[vpn].valid = 1;
-        child_pt[vpn].prot = parent->region1_pt[vpn].prot;
-
-        // Use temporary kernel mapping to copy the page
-        int clone_tmp_vpn = ((KERNEL_STACK_BASE >> PAGESHIFT) - 1);
-        
-        // Map child's physical page into kernel space temporarily
-        kernel_page_table[clone_tmp_vpn].valid = 1;
-        kernel_page_table[clone_tmp_vpn].prot = PROT_READ | PROT_WRITE;
-        kernel_page_table[clone_tmp_vpn].pfn = child_pfn;
-        WriteRegister(REG_TLB_FLUSH, clone_tmp_vpn << PAGESHIFT);
-
-        // Copy from parent's virtual address to child's physical page
-        void *dst = (void *)(clone_tmp_vpn << PAGESHIFT);
-        void *src = (void *)((VMEM_1_BASE + (vpn << PAGESHIFT)));
-        memcpy(dst, src, PAGESIZE);
-        
-        // Clean up temporary mapping
-        kernel_page_table[clone_tmp_vpn].valid = 0;
-        WriteRegister(REG_TLB_FLUSH, clone_tmp_vpn << PAGESHIFT);
+    // The child shares the parent's frames copy-on-write, so the only
+    // frames Fork needs up front are the child's kernel stack
+    unsigned int kstack[KSTACK_NPAGES];
+    if (vm_reclaim(FRAME_CLASS_PROCESS, KSTACK_NPAGES) < 0 ||
+        AllocKernelStack(kstack) < 0) {
+        TracePrintf(0, "s_Fork: Not enough free frames for a new process\n");
+        pt_free(child_pt);
+        return ERROR;
     }
 
     // Create the child PCB
     PCB *child = CreatePCB(child_pt, &parent->uctxt);
     if (child == NULL) {
         TracePrintf(0, "s_Fork: Failed to create child PCB\n");
-        // Roll back: free all allocated frames
-        for (int j = 0; j < MAX_PT_LEN; j++) {
-            if (child_pt[j].valid) {
-                free_frame_number(child_pt[j].pfn);
-            }
-        }
-        free(child_pt);
+        FreeKernelStack(kstack);
+        pt_free(child_pt);
+        return ERROR;
+    }
+
+    // Share every region-1 page with the child
+    if (vm_cow_clone(parent, child) < 0) {
+        TracePrintf(0, "s_Fork: Failed to bring back swapped pages\n");
+        FreeKernelStack(kstack);
+        DeallocatePCB(child);
         return ERROR;
     }
+    ShmFork(parent, child);
 
     // Set up parent-child relationship
     child->parent = parent;
@@ -262,15 +212,11 @@ int user_Fork(UserContext *uctxt) {
     child->brk = parent->brk;  // Important: copy the break pointer
     memcpy(&child->uctxt, &parent->uctxt, sizeof(UserContext));
 
-    int start = KERNEL_STACK_BASE >> PAGESHIFT;
-    int end = KERNEL_STACK_LIMIT >> PAGESHIFT;
-    int KERNEL_STACK_BASE_TO_LIMIT = end - start;
+    for (int i = 0; i < KSTACK_NPAGES; i++) {
+        child->kstack_pfn[i] = kstack[i];
+        frame_tag(kstack[i], child->pid, FRAME_KERNEL_STACK);
+    }
 
-    for (int i = 0; i < KERNEL_STACK_BASE_TO_LIMIT; i++) {
-      int frame = get_free_frame();
-      if (frame < 0) Halt();
-        child->kstack_pfn[i] = frame;
-    } 
     TracePrintf(0, "s_Fork: Created child process %d from parent %d\n", 
                 child->pid, parent->pid);
 
@@ -290,10 +236,8 @@ int user_Fork(UserContext *uctxt) {
         TracePrintf(0, "s_Fork: In child process %d\n", currentPCB->pid);
         //exit(0);
         
-        // Set up child's address space
-        WriteRegister(REG_PTBR1, (unsigned int)child->region1_pt);
-        WriteRegister(REG_PTLR1, MAX_PT_LEN);
-        WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_ALL);
+        // KCSwitch loaded the child's table already; this is a no-op then
+        tlb_load_region1(child->region1_pt, TLB_R_FORK);
         
         // Copy user context back to the trap frame
         memcpy(uctxt, &currentPCB->uctxt, sizeof(UserContext));
@@ -304,22 +248,114 @@ int user_Fork(UserContext *uctxt) {
         
         // Ensure parent's address space is set up correctly
         memcpy(uctxt, &currentPCB->uctxt, sizeof(UserContext));
-        WriteRegister(REG_PTBR1, (unsigned int)parent->region1_pt);
-        WriteRegister(REG_PTLR1, MAX_PT_LEN);
-        WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_ALL);
+        // vm_cow_clone flushed whatever it made read-only
+        tlb_load_region1(parent->region1_pt, TLB_R_FORK);
         
         // Copy user context back to the trap frame
         return child->pid;  // Parent returns child's PID
     }
 }
 
+//=========================================================================
+// Spawn()
+//      Create a child running a new program, without copying the caller:
+//      the child's region 1 is built straight from the executable
+//=========================================================================
+int user_Spawn(UserContext *uctxt, char *filename, char *args[]) {
+
+    if (filename == NULL || args == NULL || currentPCB == NULL) {
+        return ERROR;
+    }
+
+    // Save current user context to parent PCB
+    memcpy(&currentPCB->uctxt, uctxt, sizeof(UserContext));
+    PCB *parent = currentPCB;
+
+    pte_t *child_pt = pt_alloc();
+    if (child_pt == NULL) {
+        TracePrintf(0, "s_Spawn: Failed to allocate child page table\n");
+        return ERROR;
+    }
+
+    unsigned int kstack[KSTACK_NPAGES];
+    if (vm_reclaim(FRAME_CLASS_PROCESS, KSTACK_NPAGES) < 0 ||
+        AllocKernelStack(kstack) < 0) {
+        TracePrintf(0, "s_Spawn: Not enough free frames for a new process\n");
+        pt_free(child_pt);
+        return ERROR;
+    }
+
+    PCB *child = CreatePCB(child_pt, &parent->uctxt);
+    if (child == NULL) {
+        FreeKernelStack(kstack);
+        pt_free(child_pt);
+        return ERROR;
+    }
+    for (int i = 0; i < KSTACK_NPAGES; i++) {
+        child->kstack_pfn[i] = kstack[i];
+        frame_tag(kstack[i], child->pid, FRAME_KERNEL_STACK);
+    }
+
+    // Load the program into the child's empty region 1; the caller's
+    // address space stays mapped and untouched
+    if (LoadProgram(filename, args, child) != SUCCESS) {
+        TracePrintf(0, "s_Spawn: Failed to load '%s'\n", filename);
+        FreeKernelStack(child->kstack_pfn);
+        DeallocatePCB(child);
+        return ERROR;
+    }
+
+    child->parent = parent;
+    queue_add(parent->children, child);
+    queue_add(ready_processes, child);
+
+    TracePrintf(0, "s_Spawn: Created child process %d from parent %d\n",
+                child->pid, parent->pid);
+
+    // The child needs a kernel context to be scheduled; it starts out
+    // returning from this call into its freshly loaded user context
+    KernelContextSwitch(KCCopy, (void*)child, NULL);
+
+    if (currentPCB == child) {
+        tlb_load_region1(child->region1_pt, TLB_R_SWITCH);
+        memcpy(uctxt, &currentPCB->uctxt, sizeof(UserContext));
+        return 0;
+    }
+
+    return child->pid;
+}
+
+//=========================================================================
+// Take the zombie record of one of currentPCB's children, if any
+// Returns its pid and stores its exit status, or ERROR if there is none
+//=========================================================================
+static int reap_child(int *status) {
+
+  for (queue_node_t* node = zombie_processes->head; node != NULL; node = node->next) {
+    zombie_t* z = (zombie_t*)node->item;
+    if (z->parent == currentPCB) {
+      int child_pid = z->pid;
+      *status = z->exit_status;
+      queue_delete_node(zombie_processes, z);
+      FreeZombie(z);
+      return child_pid;
+    }
+  }
+  return ERROR;
+}
+
 //=========================================================================
 // CP4: implemented Wait()
 //      Wait for a child process to exit
 //=========================================================================
 int user_Wait(int *status) {
 
-  // Check if the current process has any children
+  int child_pid = reap_child(status);
+  if (child_pid != ERROR) {
+    return child_pid;
+  }
+
+  // Check if the current process has any children left running
   if (queue_is_empty(currentPCB->children)) {
     TracePrintf(0, "No children to wait for.\n");
     return ERROR; // No children to wait for
@@ -331,16 +367,6 @@ int user_Wait(int *status) {
     return ERROR;
   }
 
-  for (queue_node_t* child = zombie_processes->head; child != NULL; child = child->next) {
-    PCB* child_pcb = (PCB*)child->item;
-    if (child_pcb->parent == currentPCB) {
-      *status = child_pcb->exit_status;
-      queue_delete_node(currentPCB->children, child_pcb);
-      queue_delete_node(zombie_processes, child);
-      DeallocatePCB(child_pcb);
-      return child_pcb->pid;
-    }
-  }
   // Add the current process to the waiting queue
   queue_add(waiting_parent_processes, currentPCB);
 
@@ -362,18 +388,8 @@ int user_Wait(int *status) {
   //    remap stack pages & switch to next’s region1 PT, flush TLBs
   KernelContextSwitch(KCSwitch, prev, next);
 
-  for (queue_node_t* child = zombie_processes->head; child != NULL; child = child->next) {
-    PCB* child_pcb = (PCB*)child->item;
-    if (child_pcb->parent == currentPCB) {
-      *status = child_pcb->exit_status;
-      queue_delete_node(currentPCB->children, child_pcb);
-      queue_delete_node(zombie_processes, child);
-      DeallocatePCB(child_pcb);
-      return child_pcb->pid;
-    }
-  }
-
-  return 0;
+  child_pid = reap_child(status);
+  return child_pid == ERROR ? 0 : child_pid;
 }
 
 //=========================================================================
@@ -384,15 +400,23 @@ void user_Exit(int status) {
 
   if(currentPCB->pid == 1){
     TracePrintf(0, "s_Exit: init process causes halt per instructions\n");
+    image_cache_dump_stats(1);
+    tlb_dump_stats(1);
+    ksm_dump_stats(1);
     Halt();
   }
-  // Set the process state to ZOMBIE
-  currentPCB->state = PCB_ZOMBIE;
-  queue_add(zombie_processes, currentPCB);
-  currentPCB->exit_status = status;
+  // Unmap shared memory so the last user frees it now
+  ShmDetachAll(currentPCB);
+  DiskUnmapAll(currentPCB);
+  image_note_stack(currentPCB->image, vm_stack_pages(currentPCB), vm_stack_hint_max());
 
   // Check if the parent process is waiting for this child process
   PCB*parent = currentPCB->parent;
+
+  // Free the address space now and leave the parent a zombie record;
+  // KCSwitch frees the kernel stack and PCB once it is off them
+  ExitPCB(currentPCB, status);
+
   if (parent && queue_find(waiting_parent_processes, parent) != -1) {
     // Remove the parent from the waiting queue
     queue_delete_node(waiting_parent_processes, parent);
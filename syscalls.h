@@ -21,6 +21,7 @@ int user_Brk(void *addr);
 int user_Delay(int clock_ticks);
 int user_Fork(UserContext *uctxt);
 int user_Exec(char *filename, char *args[]);
+int user_Spawn(UserContext *uctxt, char *filename, char *args[]);
 int user_Wait(int *status_ptr);
 int user_Wait(int *status);
 void user_Exit(int status);
@@ -0,0 +1,29 @@
+#include <yuser.h>
+
+/* Reserve a large heap, touch only a few pages of it, and check that the
+ * pages come in zero-filled */
+int main(void)
+{
+  int npages = 20;
+  char *heap = malloc(npages * PAGESIZE);
+  int i;
+
+  if (heap == NULL) {
+    TracePrintf(0, "brktest: malloc failed\n");
+    Exit(-1);
+  }
+
+  for (i = 0; i < npages * PAGESIZE; i += 4 * PAGESIZE) {
+    if (heap[i] != 0) {
+      TracePrintf(0, "brktest: heap[%d] = %d, expected 0\n", i, heap[i]);
+      Exit(-1);
+    }
+    heap[i] = 'a';
+  }
+
+  for (i = 0; i < npages * PAGESIZE; i += 4 * PAGESIZE)
+    TracePrintf(0, "&heap[%d] = %x; heap[%d] = %c\n", i, &heap[i], i, heap[i]);
+
+  free(heap);
+  Exit(0);
+}
@@ -0,0 +1,54 @@
+#include <yuser.h>
+#include "ytest.h"
+
+#define CHILD_SEED  1
+#define PARENT_SEED 2
+
+/* Parent and child write the same data and heap pages after Fork; each
+ * must keep seeing its own values, whatever order the writes land in */
+char data[PAGESIZE] = "original";
+
+static int check(char *who, char *heap, int seed)
+{
+  if (test_check(who, data, 0, PAGESIZE, seed) < 0 ||
+      test_check(who, heap, 0, PAGESIZE, seed) < 0)
+    return -1;
+  return 0;
+}
+
+int main(void)
+{
+  char *heap = malloc(PAGESIZE);
+  int pid, status;
+
+  if (heap == NULL) {
+    TracePrintf(0, "cowtest: malloc failed\n");
+    Exit(-1);
+  }
+  test_fill(heap, 0, PAGESIZE, 0);
+
+  pid = Fork();
+  if (pid < 0) {
+    TracePrintf(0, "cowtest: Fork failed\n");
+    Exit(-1);
+  }
+
+  if (pid == 0) {
+    test_fill(data, 0, PAGESIZE, CHILD_SEED);
+    test_fill(heap, 0, PAGESIZE, CHILD_SEED);
+    Delay(3);                   /* let the parent write meanwhile */
+    Exit(check("cowtest child", heap, CHILD_SEED));
+  }
+
+  test_fill(data, 0, PAGESIZE, PARENT_SEED);
+  test_fill(heap, 0, PAGESIZE, PARENT_SEED);
+  if (Wait(&status) != pid || status != 0) {
+    TracePrintf(0, "cowtest: child exited with %d\n", status);
+    Exit(-1);
+  }
+  if (check("cowtest parent", heap, PARENT_SEED) < 0)
+    Exit(-1);
+
+  TracePrintf(0, "cowtest: passed\n");
+  Exit(0);
+}
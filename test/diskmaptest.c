@@ -0,0 +1,38 @@
+#include <yuser.h>
+#include "ycustom.h"
+#include "ytest.h"
+
+#define SECTOR   0
+#define NSECTORS (2 * PAGESIZE / SECTORSIZE)
+#define NBYTES   (NSECTORS * SECTORSIZE)
+
+/* Write a pattern through a disk mapping, unmap it, map the same sectors
+ * again and check that the writes reached the disk */
+int main(void)
+{
+  int pid = GetPid();
+  char *map = DiskMap(SECTOR, NSECTORS);
+
+  if (map == (char *)-1) {
+    TracePrintf(0, "diskmaptest: DiskMap failed\n");
+    Exit(-1);
+  }
+  test_fill(map, 0, NBYTES, pid);
+
+  if (DiskUnmap(map) != 0) {
+    TracePrintf(0, "diskmaptest: DiskUnmap failed\n");
+    Exit(-1);
+  }
+
+  map = DiskMap(SECTOR, NSECTORS);
+  if (map == (char *)-1) {
+    TracePrintf(0, "diskmaptest: second DiskMap failed\n");
+    Exit(-1);
+  }
+  if (test_check("diskmaptest", map, 0, NBYTES, pid) < 0)
+    Exit(-1);
+
+  DiskUnmap(map);
+  TracePrintf(0, "diskmaptest: passed\n");
+  Exit(0);
+}
@@ -0,0 +1,57 @@
+#include <yuser.h>
+#include "ytest.h"
+
+#define NBYTES (2 * PAGESIZE)
+
+/* Parent and child fill their own heap with the same bytes and sleep, so
+ * the idle-time scanner can merge the pages onto shared frames. The child
+ * then writes its copy, which must split the share: the parent's bytes
+ * stay as they were. "ksm" in the TRACE shows the merge happened. */
+static int check(char *who, char *buf, char value)
+{
+  if (test_check(who, buf, 0, PAGESIZE, 0) < 0 ||
+      test_check(who, buf, PAGESIZE + 1, NBYTES, 0) < 0)
+    return -1;
+  if (buf[PAGESIZE] != value) {
+    TracePrintf(0, "%s: byte %d is %d, expected %d\n", who, PAGESIZE, buf[PAGESIZE], value);
+    return -1;
+  }
+  return 0;
+}
+
+int main(void)
+{
+  int pid, status;
+  char *buf;
+
+  pid = Fork();
+  if (pid < 0) {
+    TracePrintf(0, "ksmtest: Fork failed\n");
+    Exit(-1);
+  }
+
+  /* Allocated after Fork, so each side has its own frames to merge */
+  buf = malloc(NBYTES);
+  if (buf == NULL)
+    Exit(-1);
+  test_fill(buf, 0, NBYTES, 0);
+  Delay(10);
+
+  if (pid == 0) {
+    buf[PAGESIZE] = 'c';
+    Exit(check("ksmtest child", buf, 'c'));
+  }
+
+  if (Wait(&status) != pid || status != 0) {
+    TracePrintf(0, "ksmtest: child exited with %d\n", status);
+    Exit(-1);
+  }
+  if (check("ksmtest parent", buf, test_byte(PAGESIZE, 0)) < 0)
+    Exit(-1);
+  buf[PAGESIZE] = 'p';
+  if (check("ksmtest parent", buf, 'p') < 0)
+    Exit(-1);
+
+  TracePrintf(0, "ksmtest: passed\n");
+  Exit(0);
+}
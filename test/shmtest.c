@@ -0,0 +1,58 @@
+#include <yuser.h>
+#include "ycustom.h"
+#include "ytest.h"
+
+#define NPAGES      2
+#define NBYTES      (NPAGES * PAGESIZE)
+#define PARENT_SEED 1
+#define CHILD_SEED  2
+
+/* Create a shared segment, Fork, and have the child attach it and write
+ * every byte; the parent must see those writes once the child is gone,
+ * and its detach must then free the segment */
+int main(void)
+{
+  int id, pid, status;
+  char *seg = ShmCreate(&id, NPAGES);
+
+  if (seg == (char *)-1) {
+    TracePrintf(0, "shmtest: ShmCreate failed\n");
+    Exit(-1);
+  }
+  test_fill(seg, 0, NBYTES, PARENT_SEED);
+
+  pid = Fork();
+  if (pid < 0) {
+    TracePrintf(0, "shmtest: Fork failed\n");
+    Exit(-1);
+  }
+
+  if (pid == 0) {
+    /* Fork already attached the child; attaching again finds that mapping */
+    char *mine = ShmAttach(id);
+    if (mine != seg) {
+      TracePrintf(0, "shmtest: child attached at %x, parent at %x\n", mine, seg);
+      Exit(-1);
+    }
+    if (test_check("shmtest child", mine, 0, NBYTES, PARENT_SEED) < 0)
+      Exit(-1);
+    test_fill(mine, 0, NBYTES, CHILD_SEED);
+    Exit(0);
+  }
+
+  if (Wait(&status) != pid || status != 0) {
+    TracePrintf(0, "shmtest: child exited with %d\n", status);
+    Exit(-1);
+  }
+  if (test_check("shmtest parent", seg, 0, NBYTES, CHILD_SEED) < 0)
+    Exit(-1);
+
+  /* The child is gone, so detaching frees the segment for good */
+  if (ShmDetach(id) != 0 || ShmAttach(id) != (void *)-1) {
+    TracePrintf(0, "shmtest: segment %d outlived its last detach\n", id);
+    Exit(-1);
+  }
+
+  TracePrintf(0, "shmtest: passed\n");
+  Exit(0);
+}
@@ -0,0 +1,35 @@
+#include <yuser.h>
+#include "ycustom.h"
+
+#define CHILD_STATUS 42
+
+/* Spawn a copy of this program that exits with a known status, wait for
+ * it, then check that spawning a missing file fails */
+int main(int argc, char *argv[])
+{
+  char *child_args[] = {"test/spawntest", "child", NULL};
+  char *missing_args[] = {"test/no_such_program", NULL};
+  int pid, status;
+
+  if (argc > 1)
+    Exit(CHILD_STATUS);
+
+  pid = Spawn("test/spawntest", child_args);
+  if (pid <= 0) {
+    TracePrintf(0, "spawntest: Spawn returned %d\n", pid);
+    Exit(-1);
+  }
+
+  if (Wait(&status) != pid || status != CHILD_STATUS) {
+    TracePrintf(0, "spawntest: child %d exited with %d, expected %d\n", pid, status, CHILD_STATUS);
+    Exit(-1);
+  }
+
+  if (Spawn("test/no_such_program", missing_args) >= 0) {
+    TracePrintf(0, "spawntest: Spawn of a missing file didn't fail\n");
+    Exit(-1);
+  }
+
+  TracePrintf(0, "spawntest: passed\n");
+  Exit(0);
+}
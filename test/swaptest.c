@@ -0,0 +1,100 @@
+#include <yuser.h>
+#include "ycustom.h"
+#include "ytest.h"
+
+#define VICTIM_PAGES 16
+#define VICTIM_BYTES (VICTIM_PAGES * PAGESIZE)
+#define VICTIM_SEED  7
+#define MAX_HOGS     16
+#define HOG_PAGES    96
+
+/* A child fills some heap pages and blocks on a pipe, which makes them
+ * candidates for swap. Hogs then take memory one after another, until the
+ * kernel reports pages out on swap; they block on the same pipe. When the
+ * parent writes to it, the victim's pages must fault back in unchanged.
+ * If nothing went out even after MAX_HOGS hogs, the test fails: run it
+ * with a smaller -pmem. */
+static int release;
+
+static void wait_release(void)
+{
+  char c;
+
+  PipeRead(release, &c, 1);
+}
+
+static void victim(void)
+{
+  char *pages = malloc(VICTIM_BYTES);
+
+  if (pages == NULL)
+    Exit(-1);
+  test_fill(pages, 0, VICTIM_BYTES, VICTIM_SEED);
+  wait_release();
+  Exit(test_check("swaptest victim", pages, 0, VICTIM_BYTES, VICTIM_SEED));
+}
+
+static void hog(void)
+{
+  char *p;
+  int i;
+
+  for (i = 0; i < HOG_PAGES; i++) {
+    if ((p = malloc(PAGESIZE)) == NULL)
+      break;
+    p[0] = (char)(i + 1);       /* a frame of its own, not the zero frame */
+  }
+  wait_release();
+  Exit(0);
+}
+
+int main(void)
+{
+  char go[MAX_HOGS + 1] = {0};
+  int pid, status, i, swapped;
+  int children = 1, victim_status = -1;
+  int victim_pid;
+
+  if (PipeInit(&release) < 0) {
+    TracePrintf(0, "swaptest: PipeInit failed\n");
+    Exit(-1);
+  }
+  victim_pid = Fork();
+  if (victim_pid == 0)
+    victim();
+  if (victim_pid < 0) {
+    TracePrintf(0, "swaptest: Fork failed\n");
+    Exit(-1);
+  }
+  Delay(2);                     /* let the victim fill its pages and block */
+
+  for (i = 0; i < MAX_HOGS && DiskSwapped() == 0; i++) {
+    pid = Fork();
+    if (pid == 0)
+      hog();
+    if (pid < 0)
+      break;
+    children++;
+    Delay(2);                   /* let the hog take its memory */
+  }
+  swapped = DiskSwapped();
+
+  /* One byte wakes each child; a hog killed for lack of memory leaves
+   * its byte unread. Only the victim's status counts. */
+  PipeWrite(release, go, children);
+  while ((pid = Wait(&status)) > 0) {
+    if (pid == victim_pid)
+      victim_status = status;
+  }
+
+  if (swapped == 0) {
+    TracePrintf(0, "swaptest: nothing was swapped out; run with a smaller -pmem\n");
+    Exit(-1);
+  }
+  if (victim_status != 0) {
+    TracePrintf(0, "swaptest: victim %d exited with %d\n", victim_pid, victim_status);
+    Exit(-1);
+  }
+  TracePrintf(0, "swaptest: passed (%d pages out on swap)\n", swapped);
+  Exit(0);
+}
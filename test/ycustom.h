@@ -0,0 +1,58 @@
+/* ycustom.h - User stubs for the kernel calls this kernel adds
+ *
+ * The library has no stubs of its own for them: each goes through one of
+ * its generic CustomN() traps, whose four arguments reach the kernel in
+ * regs[0..3]. The trap codes are the YALNIX_CUSTOM_* ones in yalnix.h.
+ */
+
+#ifndef _ycustom_h
+#define _ycustom_h
+
+#include <yuser.h>
+
+/* Fork + Exec in one call; returns the child's pid, or -1 on failure */
+static inline int Spawn(char *filename, char **argv)
+{
+  return Custom0((int)filename, (int)argv, 0, 0);
+}
+
+/* Create an npages shared segment and map it; stores its id in *shm_idp
+ * and returns its address, or -1 on failure */
+static inline void *ShmCreate(int *shm_idp, int npages)
+{
+  return (void *)Custom1(SHM_OP_CREATE, (int)shm_idp, npages, 0);
+}
+
+/* Map segment shm_id, or find where it already is; -1 on failure */
+static inline void *ShmAttach(int shm_id)
+{
+  return (void *)Custom1(SHM_OP_ATTACH, shm_id, 0, 0);
+}
+
+/* Unmap segment shm_id; the last process to detach frees it.
+ * Returns 0, or -1 if the caller doesn't map it */
+static inline int ShmDetach(int shm_id)
+{
+  return Custom1(SHM_OP_DETACH, shm_id, 0, 0);
+}
+
+/* Map nsectors disk sectors from sector onward; returns their address,
+ * or -1 on failure */
+static inline void *DiskMap(int sector, int nsectors)
+{
+  return (void *)Custom2(DISK_OP_MAP, sector, nsectors, 0);
+}
+
+/* Write back and unmap what DiskMap returned; 0, or -1 on failure */
+static inline int DiskUnmap(void *addr)
+{
+  return Custom2(DISK_OP_UNMAP, (int)addr, 0, 0);
+}
+
+/* How many pages are out on swap right now */
+static inline int DiskSwapped(void)
+{
+  return Custom2(DISK_OP_SWAPPED, 0, 0, 0);
+}
+
+#endif /* _ycustom_h */
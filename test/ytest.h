@@ -0,0 +1,44 @@
+/* ytest.h - Fill and check helpers shared by the test programs
+ *
+ * A buffer is filled with a pattern that depends on each byte's offset
+ * and on a seed, so a page that comes back from the wrong frame, the
+ * wrong process or the wrong disk sector reads wrong. No pattern byte is
+ * zero, so a page that was lost and zero-filled never passes.
+ */
+
+#ifndef _ytest_h
+#define _ytest_h
+
+#include <yuser.h>
+
+/* The byte at offset i of a buffer filled with seed */
+static inline char test_byte(int i, int seed)
+{
+  return (char)((i + seed) % 251 + 1);
+}
+
+/* Fill bytes [from, to) of buf */
+static inline void test_fill(char *buf, int from, int to, int seed)
+{
+  int i;
+
+  for (i = from; i < to; i++)
+    buf[i] = test_byte(i, seed);
+}
+
+/* Check bytes [from, to) of buf; traces the first wrong one as who's and
+ * returns -1, or returns 0 if all are right */
+static inline int test_check(char *who, char *buf, int from, int to, int seed)
+{
+  int i;
+
+  for (i = from; i < to; i++) {
+    if (buf[i] != test_byte(i, seed)) {
+      TracePrintf(0, "%s: byte %d is %d, expected %d\n", who, i, buf[i], test_byte(i, seed));
+      return -1;
+    }
+  }
+  return 0;
+}
+
+#endif /* _ytest_h */
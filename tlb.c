@@ -0,0 +1,77 @@
+#include "tlb.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+//======================================================================
+// Flush policy state and counters
+//======================================================================
+static pte_t *loaded_pt1 = NULL;        // Table currently in REG_PTBR1
+static int    flushes[TLB_R_NUM];       // Flushes issued, by reason
+static int    skipped = 0;              // Table loads that needed no flush
+
+void tlb_flush_page(unsigned int addr, tlb_reason_t why) {
+    WriteRegister(REG_TLB_FLUSH, addr);
+    flushes[why]++;
+}
+
+void tlb_flush_region1(tlb_reason_t why) {
+    WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_1);
+    flushes[why]++;
+}
+
+void tlb_flush_kstack(tlb_reason_t why) {
+    WriteRegister(REG_TLB_FLUSH, TLB_FLUSH_KSTACK);
+    flushes[why]++;
+}
+
+//======================================================================
+// Make pt the region-1 page table. Only a change of table flushes, and
+// only region 1; a caller that edits the loaded table in place flushes
+// what it changed itself.
+//======================================================================
+void tlb_load_region1(pte_t *pt, tlb_reason_t why) {
+    if (pt == loaded_pt1) {
+        skipped++;
+        return;
+    }
+    WriteRegister(REG_PTBR1, (unsigned int)pt);
+    WriteRegister(REG_PTLR1, MAX_PT_LEN);
+    loaded_pt1 = pt;
+    tlb_flush_region1(why);
+}
+
+//======================================================================
+// pt is being freed; if it is loaded, the next load must not be skipped
+// even if the same table comes back for another process
+//======================================================================
+void tlb_forget_region1(pte_t *pt) {
+    if (pt == loaded_pt1) {
+        loaded_pt1 = NULL;
+    }
+}
+
+pte_t *tlb_region1(void) {
+    return loaded_pt1;
+}
+
+//======================================================================
+// Counters: flushes[TLB_R_NUM] by reason, and skipped table loads
+//======================================================================
+void tlb_stats(int *counts, int *skips) {
+    for (int r = 0; r < TLB_R_NUM; r++) {
+        counts[r] = flushes[r];
+    }
+    *skips = skipped;
+}
+
+void tlb_dump_stats(int level) {
+    static const char *names[TLB_R_NUM] = {
+        "switch", "exec", "fork", "fault", "unmap", "kernel"
+    };
+
+    TracePrintf(level, "tlb flushes (%d table loads skipped):\n", skipped);
+    for (int r = 0; r < TLB_R_NUM; r++) {
+        TracePrintf(level, "  %-8s %d\n", names[r], flushes[r]);
+    }
+}
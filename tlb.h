@@ -0,0 +1,35 @@
+/* tlb.h - TLB flush policy and accounting */
+
+#ifndef _TLB_H
+#define _TLB_H
+
+#include "hardware.h"
+#include "yalnix.h"
+
+//==========================================================================
+// Every TLB flush goes through here, tagged with why it was needed.
+// Loading the region-1 table that is already loaded costs nothing;
+// switching tables flushes region 1 only, since region 0 is shared by
+// every process. The kernel stack is flushed only when its frames change.
+//==========================================================================
+typedef enum tlb_reason {
+    TLB_R_SWITCH,   /* context switch to another address space */
+    TLB_R_EXEC,     /* LoadProgram replaced or installed region 1 */
+    TLB_R_FORK,     /* Fork: parent pages turned copy-on-write */
+    TLB_R_FAULT,    /* page brought in, made private or grown */
+    TLB_R_UNMAP,    /* user pages released: Brk, swap, shared memory */
+    TLB_R_KERNEL,   /* region-0 mappings: kernel heap, temporary pages */
+    TLB_R_NUM
+} tlb_reason_t;
+
+void   tlb_flush_page(unsigned int addr, tlb_reason_t why);
+void   tlb_flush_region1(tlb_reason_t why);
+void   tlb_flush_kstack(tlb_reason_t why);
+void   tlb_load_region1(pte_t *pt, tlb_reason_t why);
+void   tlb_forget_region1(pte_t *pt);
+pte_t *tlb_region1(void);
+
+void   tlb_stats(int *counts, int *skips);
+void   tlb_dump_stats(int level);
+
+#endif /* _TLB_H */
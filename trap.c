@@ -17,6 +17,13 @@
 #include "ipc.h"
 #include "sync_lock.h"
 #include "sync_cvar.h"
+#include "vm.h"
+#include "shm.h"
+#include "diskmap.h"
+#include "disk.h"
+#include "ksm.h"
+#include "buddy.h"
+#include "swap.h"
 #include <stdlib.h>
 #include <yuser.h>
 
@@ -47,6 +54,16 @@ static void delay_helper(void* item, void *ctx, void* ctx2) {
 //====================================================================== 
 void TrapClockHandler(UserContext *uctxt) {
 
+    // Idle had the CPU: spend the tick clearing frames for the zero pool,
+    // taking a lent block back into the buddy zone, warming a kernel
+    // stack for the next Fork and merging identical pages
+    if (currentPCB == idlePCB) {
+        frame_zero_idle(ZERO_POOL_BATCH);
+        buddy_refill(1);
+        KernelStackPoolFill();
+        ksm_scan();
+    }
+
     queue_iterate(blocked_processes, delay_helper, NULL, NULL);
 
     // 2) Decide which PCB to run next
@@ -100,14 +117,35 @@ void TrapKernelHandler(UserContext *uctxt) {
             // args in regs[0]=filename, regs[1]=argv
             char *filename = (char *)uctxt->regs[0];
             char **args    = (char **)uctxt->regs[1];
+            if (vm_prepare_user_string(currentPCB, filename) < 0 ||
+                vm_prepare_user_argv(currentPCB, args) < 0) {
+                break;
+            }
             retval = user_Exec(filename, args);
             TracePrintf(0, "\n=========\nYALNIX_EXEC(2)\n=========\n");
             break;
         }
       
+        case YALNIX_SPAWN: {
+            TracePrintf(0, "\n=========\nYALNIX_SPAWN(1)\n=========\n");
+            // args in regs[0]=filename, regs[1]=argv
+            char *filename = (char *)uctxt->regs[0];
+            char **args    = (char **)uctxt->regs[1];
+            if (vm_prepare_user_string(currentPCB, filename) < 0 ||
+                vm_prepare_user_argv(currentPCB, args) < 0) {
+                break;
+            }
+            retval = user_Spawn(uctxt, filename, args);
+            TracePrintf(0, "\n=========\nYALNIX_SPAWN(2)\n=========\n");
+            break;
+        }
+
         case YALNIX_WAIT: {
             TracePrintf(0, "\n=========\nYALNIX_WAIT(1)\n=========\n");
             int *status = (int *)uctxt->regs[0];
+            if (vm_prepare_user_write(currentPCB, status, sizeof(int)) < 0) {
+                break;
+            }
             retval = user_Wait(status);
             TracePrintf(0, "\n=========\nYALNIX_WAIT(2)\n=========\n");
             break;
@@ -149,6 +187,9 @@ void TrapKernelHandler(UserContext *uctxt) {
             int tty_id = uctxt->regs[0];
             void *buf = (void *)uctxt->regs[1];
             int size = uctxt->regs[2];
+            if (vm_prepare_user_write(currentPCB, buf, size) < 0) {
+                break;
+            }
             retval = user_TtyRead(tty_id, buf, size);
             if (currentPCB->kernel_read_buffer != NULL && retval > 0){
                 memcpy(buf, currentPCB->kernel_read_buffer, retval);
@@ -165,6 +206,9 @@ void TrapKernelHandler(UserContext *uctxt) {
             int tty_id = uctxt->regs[0];
             void *buf = (void *)uctxt->regs[1];
             int size = uctxt->regs[2];
+            if (vm_prepare_user_read(currentPCB, buf, size) < 0) {
+                break;
+            }
             retval = user_TtyWrite(tty_id, buf, size);
             TracePrintf(0, "\n=========\nYALNIX_TTY_WRITE(2)\n=========\n");
             break;
@@ -173,6 +217,9 @@ void TrapKernelHandler(UserContext *uctxt) {
         case YALNIX_PIPE_INIT: {
             TracePrintf(0, "\n=========\nYALNIX_PIPE_INIT(1)\n=========\n");
             int *pipe_idp = (int *)uctxt->regs[0];
+            if (vm_prepare_user_write(currentPCB, pipe_idp, sizeof(int)) < 0) {
+                break;
+            }
             retval = PipeInit(pipe_idp);
             TracePrintf(0, "\n=========\nYALNIX_PIPE_INIT(2)\n=========\n");
             break;
@@ -183,6 +230,9 @@ void TrapKernelHandler(UserContext *uctxt) {
             int pipe_id = uctxt->regs[0];
             void *buf = (void *)uctxt->regs[1];
             int len = uctxt->regs[2];
+            if (vm_prepare_user_write(currentPCB, buf, len) < 0) {
+                break;
+            }
             retval = PipeRead(pipe_id, buf, len);
             TracePrintf(0, "\n=========\nYALNIX_PIPE_READ(2)\n=========\n");
             break;
@@ -193,6 +243,9 @@ void TrapKernelHandler(UserContext *uctxt) {
             int pipe_id = uctxt->regs[0];
             void *buf = (void *)uctxt->regs[1];
             int len = uctxt->regs[2];
+            if (vm_prepare_user_read(currentPCB, buf, len) < 0) {
+                break;
+            }
             retval = PipeWrite(pipe_id, buf, len);
             TracePrintf(0, "\n=========\nYALNIX_PIPE_WRITE(2)\n=========\n");
             break;
@@ -201,6 +254,9 @@ void TrapKernelHandler(UserContext *uctxt) {
         case YALNIX_LOCK_INIT: {
             TracePrintf(0, "\n=========\nYALNIX_LOCK_INIT(1)\n=========\n");
             int *lock_idp = (int *)uctxt->regs[0];
+            if (vm_prepare_user_write(currentPCB, lock_idp, sizeof(int)) < 0) {
+                break;
+            }
             retval = LockInit(lock_idp);
             TracePrintf(0, "\n=========\nYALNIX_LOCK_INIT(2)\n=========\n");
             break;
@@ -225,6 +281,9 @@ void TrapKernelHandler(UserContext *uctxt) {
         case YALNIX_CVAR_INIT: {
             TracePrintf(0, "\n=========\nYALNIX_CVAR_INIT(1)\n=========\n");
             int *cvar_idp = (int *)uctxt->regs[0];
+            if (vm_prepare_user_write(currentPCB, cvar_idp, sizeof(int)) < 0) {
+                break;
+            }
             retval = CvarInit(cvar_idp);
             TracePrintf(0, "\n=========\nYALNIX_CVAR_INIT(2)\n=========\n");
             break;
@@ -255,6 +314,42 @@ void TrapKernelHandler(UserContext *uctxt) {
             break;
         }
 
+        case YALNIX_SHM: {
+            TracePrintf(0, "\n=========\nYALNIX_SHM(1)\n=========\n");
+            if (uctxt->regs[0] == SHM_OP_CREATE) {
+                int *shm_idp = (int *)uctxt->regs[1];
+                int npages = uctxt->regs[2];
+                if (vm_prepare_user_write(currentPCB, shm_idp, sizeof(int)) < 0) {
+                    break;
+                }
+                retval = ShmCreate(shm_idp, npages);
+            } else if (uctxt->regs[0] == SHM_OP_ATTACH) {
+                int shm_id = uctxt->regs[1];
+                retval = ShmAttach(shm_id);
+            } else if (uctxt->regs[0] == SHM_OP_DETACH) {
+                int shm_id = uctxt->regs[1];
+                retval = ShmDetach(shm_id);
+            }
+            TracePrintf(0, "\n=========\nYALNIX_SHM(2)\n=========\n");
+            break;
+        }
+
+        case YALNIX_DISK_MAP: {
+            TracePrintf(0, "\n=========\nYALNIX_DISK_MAP(1)\n=========\n");
+            if (uctxt->regs[0] == DISK_OP_MAP) {
+                int sector = uctxt->regs[1];
+                int nsectors = uctxt->regs[2];
+                retval = DiskMap(sector, nsectors);
+            } else if (uctxt->regs[0] == DISK_OP_UNMAP) {
+                void *addr = (void *)uctxt->regs[1];
+                retval = DiskUnmap(addr);
+            } else if (uctxt->regs[0] == DISK_OP_SWAPPED) {
+                retval = SWAP_NSLOTS - swap_free_slots();
+            }
+            TracePrintf(0, "\n=========\nYALNIX_DISK_MAP(2)\n=========\n");
+            break;
+        }
+
         case YALNIX_RECLAIM: {
             TracePrintf(0, "\n=========\nYALNIX_RECLAIM(1)\n=========\n");
             int pid = uctxt->regs[0];
@@ -270,6 +365,9 @@ void TrapKernelHandler(UserContext *uctxt) {
     // Advance PC to avoid re‑issuing the syscall
     //currentPCB->uctxt.pc = (void *)((char *)currentPCB->uctxt.pc + 4);
 
+    // The call is done with the user buffers it prepared
+    vm_unpin_all(currentPCB);
+
     // Restore updated user registers back to the trap frame
     memcpy(uctxt, &currentPCB->uctxt, sizeof(UserContext));
     // Place return value in r0
@@ -284,38 +382,47 @@ void TrapKernelHandler(UserContext *uctxt) {
 void TrapMemoryHandler(UserContext *uctxt) {
 
     if (uctxt->code == YALNIX_ACCERR){
+        // A write to a shared copy-on-write page: give it a private frame
+        unsigned int addr = (unsigned int)uctxt->addr;
+        if (addr >= VMEM_1_BASE && addr < VMEM_1_LIMIT &&
+            vm_cow_fault(currentPCB, (addr - VMEM_1_BASE) >> PAGESHIFT) == 0) {
+            return;
+        }
         TracePrintf(0, "YALNIX_ACCERR: invalid permissions\n");
         user_Exit(ERROR);
+        return;
     }
 
     if (uctxt->code == YALNIX_MAPERR){
         TracePrintf(0, "YALNIX_MAPPER: address not mapped\n");
+        // First touch of a page LoadProgram left to be demand-loaded
+        unsigned int addr = (unsigned int)uctxt->addr;
+        if (addr >= VMEM_1_BASE && addr < VMEM_1_LIMIT &&
+            (currentPCB->vpages[(addr - VMEM_1_BASE) >> PAGESHIFT].flags & VPG_BACKED)) {
+            if (vm_page_fault(currentPCB, (addr - VMEM_1_BASE) >> PAGESHIFT) == 0) {
+                return;
+            }
+            TracePrintf(0, "pid %d: can't page in %p\n", currentPCB->pid, uctxt->addr);
+            user_Exit(ERROR);
+            return;
+        }
     }
     TracePrintf(0, "TrapMemoryHandler: uctxt->addr: %p\n", uctxt->addr);
-    // Save the user registers
 
-    //Compute fault‐page, stack‐page, and heap‐page
+    // Compute fault-page, stack-page and the first page above the heap,
+    // from the live stack pointer in the trap frame
     unsigned int fault = (unsigned int)uctxt->addr;
-    unsigned int page = (fault - VMEM_1_BASE) >> PAGESHIFT;
-    unsigned int spage = (((unsigned int)currentPCB->uctxt.sp - VMEM_1_BASE) >> PAGESHIFT);
-    unsigned int heap_page = (((unsigned int)currentPCB->brk - VMEM_1_BASE) >> PAGESHIFT);
-
+    int page = (int)(fault - VMEM_1_BASE) >> PAGESHIFT;
+    int spage = (int)((unsigned int)uctxt->sp - VMEM_1_BASE) >> PAGESHIFT;
+    int heap_top = (int)(UP_TO_PAGE((unsigned int)currentPCB->brk) - VMEM_1_BASE) >> PAGESHIFT;
 
     // Check for implicit stack growth: in R1, below SP, above heap
-    if (fault >= VMEM_1_BASE && page <= spage && (page >= heap_page)) {
-        // Grow the stack one page at a time 
-        for (int p = spage; p >= (int)page; p--) {
-            int frame = get_free_frame();
-            if (frame < 0){
-                TracePrintf(0, "pid %d: out of memory\n", currentPCB->pid);
-                Halt();
-            }
-            currentPCB->region1_pt[p].valid = 1;
-            currentPCB->region1_pt[p].pfn   = frame;
-            currentPCB->region1_pt[p].prot  = PROT_READ | PROT_WRITE;
-
-            // Flush R1 TLB so new pages take effect
-            WriteRegister(REG_TLB_FLUSH,  VMEM_1_BASE + (p << PAGESHIFT));
+    if (fault >= VMEM_1_BASE && fault < VMEM_1_LIMIT && page <= spage && page >= heap_top) {
+        // Stack growth is a user allocation: past the min watermark the
+        // process dies, the kernel keeps its reserve
+        if (vm_grow_stack(currentPCB, page, spage, heap_top) < 0) {
+            TracePrintf(0, "pid %d: out of memory growing the stack\n", currentPCB->pid);
+            user_Exit(ERROR);
         }
 
         // Resume the faulting process 
@@ -446,11 +553,13 @@ void TrapTtyTransmitHandler(UserContext *uctxt) {
 }
 
 //======================================================================
-// CP6: Trap handler for disk errors
+// CP6: Trap handler for disk completions
+//      The sector a transfer started is done: wake the process that
+//      sleeps on it. Whoever was running carries on.
 //======================================================================
 void TrapDiskHandler(UserContext *uctxt) {
-    TracePrintf(1, "YALNIX_DISK: %d THIS TRAP CAN BE IGNORED VIA DOCUMENTATION\n", uctxt->regs[0]); //FIXME: IS THIS WHERE I get my exit code from?
-    user_Exit(uctxt->regs[0]);
+    TracePrintf(1, "YALNIX_DISK: sector done, pid %d running\n", currentPCB->pid);
+    disk_interrupt();
 }
 
 //======================================================================
@@ -0,0 +1,527 @@
+#include <string.h>
+#include <unistd.h>
+#include "vm.h"
+#include "image.h"
+#include "buddy.h"
+#include "swap.h"
+#include "tlb.h"
+#include "diskmap.h"
+#include "kernel.h"
+#include "frame.h"
+#include "process.h"
+#include "hardware.h"
+#include "yalnix.h"
+#include "ykernel.h"
+
+static int stack_lookahead = STACK_LOOKAHEAD;   // Pages mapped past a stack fault
+static int stack_hint_max  = STACK_HINT_MAX;    // Deepest stack Exec maps up front
+
+//======================================================================
+// Copy region-1 page vpn of the current address space into frame pfn
+// through the kernel mapping window
+//======================================================================
+static void copy_page_to_frame(int vpn, int pfn) {
+    void *page = frame_map_temp(pfn);
+    memcpy(page, (void *)(VMEM_1_BASE + (vpn << PAGESHIFT)), PAGESIZE);
+    frame_unmap_temp(page);
+}
+
+//======================================================================
+// Record how pages [first, last) of pcb get their contents on first
+// touch, and leave them not present. VPG_FILE and VPG_DISK pages read
+// nbytes of the image or disk from offset onward, one page each; pages
+// past the end of those bytes are zero-filled.
+//======================================================================
+void vm_set_backing(PCB *pcb, int first, int last, int kind, int prot,
+                    frame_use_t use, unsigned int offset, unsigned int nbytes) {
+
+    for (int vpn = first; vpn < last; vpn++) {
+        unsigned int skip = (vpn - first) << PAGESHIFT;
+        vpage_t *vp = &pcb->vpages[vpn];
+
+        vp->flags  = VPG_ZERO;
+        vp->prot   = prot;
+        vp->use    = use;
+        vp->offset = 0;
+        vp->nbytes = 0;
+        if ((kind == VPG_FILE || kind == VPG_DISK) && nbytes > skip) {
+            vp->flags  = kind;
+            vp->offset = offset + skip;
+            vp->nbytes = (nbytes - skip < PAGESIZE) ? nbytes - skip : PAGESIZE;
+        }
+        pcb->region1_pt[vpn].valid = 0;
+    }
+}
+
+//======================================================================
+// Finish bringing in page vpn of pcb once its frame is in the page
+// table: apply the page's protection and forget its backing record. A
+// writable page whose frame the image cache also holds is mapped
+// copy-on-write so the cached copy stays pristine; so is a disk-mapped
+// page, so that its first write marks it dirty.
+//======================================================================
+static void map_backed_page(PCB *pcb, int vpn, int shared) {
+    pte_t   *pte = &pcb->region1_pt[vpn];
+    vpage_t *vp  = &pcb->vpages[vpn];
+
+    pte->valid = 1;
+    pte->prot  = vp->prot;
+    vp->flags  = (vp->flags & ~VPG_BACKED) | VPG_REF;
+    if (shared && (vp->prot & PROT_WRITE)) {
+        pte->prot &= ~PROT_WRITE;
+        vp->flags |= VPG_COW;
+    }
+    tlb_flush_page(VMEM_1_BASE + (vpn << PAGESHIFT), TLB_R_FAULT);
+}
+
+//======================================================================
+// Bring not-present page vpn of pcb (the current process) in from its
+// backing record
+// Returns 0 once the page is mapped, ERROR if it has no backing, no
+// frame is available or the image can't be read
+//======================================================================
+int vm_page_fault(PCB *pcb, int vpn) {
+
+    if (vpn < 0 || vpn >= MAX_PT_LEN) {
+        return ERROR;
+    }
+
+    pte_t   *pte = &pcb->region1_pt[vpn];
+    vpage_t *vp  = &pcb->vpages[vpn];
+    if (pte->valid || !(vp->flags & VPG_BACKED)) {
+        return ERROR;
+    }
+
+    unsigned int addr = VMEM_1_BASE + (vpn << PAGESHIFT);
+
+    // A file page some process already read is mapped from the image cache
+    int cached = (vp->flags & VPG_FILE) && pcb->image != NULL;
+    if (cached) {
+        int shared = image_frame(pcb->image, vp->offset);
+        if (shared >= 0) {
+            frame_ref(shared);
+            pte->pfn = shared;
+            map_backed_page(pcb, vpn, 1);
+            return 0;
+        }
+    }
+
+    // A page that starts out zero maps the shared zero frame until written
+    if ((vp->flags & VPG_BACKED) == VPG_ZERO) {
+        frame_ref(frame_zero_page());
+        pte->pfn = frame_zero_page();
+        map_backed_page(pcb, vpn, 1);
+        return 0;
+    }
+
+    if (vm_reclaim(FRAME_CLASS_USER, 1) < 0) {
+        TracePrintf(0, "vm_page_fault: pid %d out of memory\n", pcb->pid);
+        return ERROR;
+    }
+
+    // A page read whole from the image or swap doesn't need clearing first
+    int whole = (vp->flags & VPG_SWAP) ||
+                ((vp->flags & (VPG_FILE | VPG_DISK)) && vp->nbytes == PAGESIZE);
+    int pfn = whole ? get_free_frame() : get_zeroed_frame();
+
+    // Swap and disk pages are read into the frame before it is mapped:
+    // the process sleeps on the disk meanwhile
+    if (vp->flags & (VPG_SWAP | VPG_DISK)) {
+        int rc = (vp->flags & VPG_SWAP) ? swap_read(vp->offset, pfn)
+                                        : DiskMapRead(vp->offset, vp->nbytes, pfn);
+        if (rc < 0) {
+            TracePrintf(0, "vm_page_fault: pid %d can't read page %d from disk\n", pcb->pid, vpn);
+            free_frame_number(pfn);
+            return ERROR;
+        }
+    }
+    pte->pfn = pfn;
+
+    // Map a file page writable so the kernel can fill it, then apply the real protection
+    if (vp->flags & VPG_FILE) {
+        pte->valid = 1;
+        pte->prot  = PROT_READ | PROT_WRITE;
+        tlb_flush_page(addr, TLB_R_FAULT);
+        if (pcb->image == NULL ||
+            lseek(pcb->image->fd, vp->offset, SEEK_SET) < 0 ||
+            read(pcb->image->fd, (void *)addr, vp->nbytes) != vp->nbytes) {
+            TracePrintf(0, "vm_page_fault: pid %d can't read page %d\n", pcb->pid, vpn);
+            pte->valid = 0;
+            free_frame_number(pfn);
+            tlb_flush_page(addr, TLB_R_FAULT);
+            return ERROR;
+        }
+    }
+
+    if (cached) {
+        image_set_frame(pcb->image, vp->offset, pfn, vp->use);
+    } else {
+        frame_tag(pfn, pcb->pid, vp->use);
+    }
+    // A disk-mapped page starts clean: its first write faults and marks it
+    map_backed_page(pcb, vpn, cached || (vp->flags & VPG_DMAP));
+    return 0;
+}
+
+//======================================================================
+// Make room for nframes frames of class cls: borrow free frames of the
+// buddy zone first, then drop idle cached images, then page out memory
+// of blocked processes
+// Returns 0 if the frames are now available, ERROR otherwise
+//======================================================================
+int vm_reclaim(frame_class_t cls, int nframes) {
+    int missing = nframes - frames_available(cls);
+
+    if (missing > 0) {
+        buddy_lend(missing);
+        missing = nframes - frames_available(cls);
+    }
+    if (missing > 0) {
+        image_cache_reclaim(missing);
+        missing = nframes - frames_available(cls);
+    }
+    if (missing > 0) {
+        swap_reclaim(missing);
+    }
+    return frames_available(cls) >= nframes ? 0 : ERROR;
+}
+
+//======================================================================
+// Find npages free region 1 pages for a mapping: as high as possible,
+// stack_gap pages below the stack and one page above the heap
+// Returns the first page of the run, or ERROR if there is no room
+//======================================================================
+int vm_find_gap(PCB *pcb, int npages, int stack_gap) {
+    int heap_top = (UP_TO_PAGE((unsigned int)pcb->brk) - VMEM_1_BASE) >> PAGESHIFT;
+    int stack_page = ((unsigned int)pcb->uctxt.sp - VMEM_1_BASE) >> PAGESHIFT;
+
+    for (int base = stack_page - stack_gap - npages; base > heap_top; base--) {
+        int free_run = 1;
+        for (int vpn = base; vpn < base + npages; vpn++) {
+            if (pcb->region1_pt[vpn].valid || pcb->vpages[vpn].flags != 0) {
+                free_run = 0;
+                break;
+            }
+        }
+        if (free_run) {
+            return base;
+        }
+    }
+    return ERROR;
+}
+
+//======================================================================
+// Grow the stack of pcb (the current process) from top_vpn down to the
+// faulting page, then up to stack_lookahead free pages further down while
+// frames are to spare, staying above floor_vpn. Pages already mapped or
+// backed are left alone, and the batch costs one TLB flush.
+// Returns 0 on success, ERROR if the faulting range can't be backed
+//======================================================================
+int vm_grow_stack(PCB *pcb, int fault_vpn, int top_vpn, int floor_vpn) {
+
+    int missing = 0;
+    for (int vpn = top_vpn; vpn >= fault_vpn; vpn--) {
+        if (!pcb->region1_pt[vpn].valid && !(pcb->vpages[vpn].flags & VPG_BACKED)) {
+            missing++;
+        }
+    }
+    if (vm_reclaim(FRAME_CLASS_USER, missing) < 0) {
+        return ERROR;
+    }
+
+    // Lookahead is speculative: it only takes frames nobody is short of
+    int spare = frames_available(FRAME_CLASS_USER) - missing;
+    int extra = 0;
+    while (extra < stack_lookahead && extra < spare) {
+        int vpn = fault_vpn - extra - 1;
+        if (vpn <= floor_vpn || pcb->region1_pt[vpn].valid || pcb->vpages[vpn].flags != 0) {
+            break;
+        }
+        extra++;
+    }
+
+    int mapped = 0;
+    int last   = -1;
+    for (int vpn = top_vpn; vpn >= fault_vpn - extra; vpn--) {
+        if (pcb->region1_pt[vpn].valid || (pcb->vpages[vpn].flags & VPG_BACKED)) {
+            continue;
+        }
+        int pfn = get_zeroed_frame();
+        frame_tag(pfn, pcb->pid, FRAME_USER_STACK);
+        pcb->region1_pt[vpn].valid = 1;
+        pcb->region1_pt[vpn].prot  = PROT_READ | PROT_WRITE;
+        pcb->region1_pt[vpn].pfn   = pfn;
+        mapped++;
+        last = vpn;
+    }
+
+    if (mapped == 1) {
+        tlb_flush_page(VMEM_1_BASE + (last << PAGESHIFT), TLB_R_FAULT);
+    } else if (mapped > 1) {
+        tlb_flush_region1(TLB_R_FAULT);
+    }
+    return 0;
+}
+
+//======================================================================
+// Depth of pcb's stack in pages, counting pages swapped out or merged
+//======================================================================
+int vm_stack_pages(PCB *pcb) {
+    int n = 0;
+
+    for (int vpn = MAX_PT_LEN - 1; vpn >= 0; vpn--) {
+        pte_t *pte = &pcb->region1_pt[vpn];
+        int use = pte->valid ? frame_desc(pte->pfn)->use : ERROR;
+        if (use == FRAME_USER_MERGED) {
+            use = pcb->vpages[vpn].use;
+        }
+        if (pte->valid ? use != FRAME_USER_STACK
+                       : !((pcb->vpages[vpn].flags & VPG_SWAP) &&
+                           pcb->vpages[vpn].use == FRAME_USER_STACK)) {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+//======================================================================
+// Pages stack growth maps past the faulting one, and the deepest stack
+// Exec maps up front; 0 turns either off
+// Returns 0, or ERROR if either is negative or beyond region 1
+//======================================================================
+int vm_set_stack_growth(int lookahead, int hint_max) {
+    if (lookahead < 0 || lookahead >= MAX_PT_LEN || hint_max < 0 || hint_max >= MAX_PT_LEN) {
+        return ERROR;
+    }
+    stack_lookahead = lookahead;
+    stack_hint_max  = hint_max;
+    return 0;
+}
+
+int vm_stack_hint_max(void) {
+    return stack_hint_max;
+}
+
+//======================================================================
+// Share every region-1 page of parent with child. Writable pages become
+// read-only copy-on-write in both; read-only pages and shared memory
+// segments are simply shared.
+// Pages not yet brought in keep their backing record in the child;
+// swapped-out pages are brought back first, since a slot has one owner.
+// Disk mappings aren't inherited: the child's pages are a private copy.
+// The parent's table is live, so its region-1 TLB entries are flushed
+// if any page was made read-only.
+// Returns 0 on success, ERROR (child untouched) if a page can't come back
+//======================================================================
+int vm_cow_clone(PCB *parent, PCB *child) {
+
+    for (int vpn = 0; vpn < MAX_PT_LEN; vpn++) {
+        if ((parent->vpages[vpn].flags & VPG_SWAP) && vm_page_fault(parent, vpn) < 0) {
+            return ERROR;
+        }
+    }
+
+    child->image = image_get(parent->image);
+
+    int demoted = 0;
+    for (int vpn = 0; vpn < MAX_PT_LEN; vpn++) {
+        pte_t *ppte = &parent->region1_pt[vpn];
+        if (!ppte->valid) {
+            child->vpages[vpn] = parent->vpages[vpn];
+            child->vpages[vpn].flags &= ~VPG_DMAP;
+            continue;
+        }
+
+        if ((ppte->prot & PROT_WRITE) && !(parent->vpages[vpn].flags & VPG_SHARED)) {
+            ppte->prot &= ~PROT_WRITE;
+            parent->vpages[vpn].flags |= VPG_COW;
+            demoted++;
+        }
+
+        frame_ref(ppte->pfn);
+        child->region1_pt[vpn] = *ppte;
+        child->vpages[vpn] = parent->vpages[vpn];
+        child->vpages[vpn].flags &= ~(VPG_DMAP | VPG_DIRTY);
+    }
+
+    // Only entries that lost their write permission can be stale
+    if (demoted > 0) {
+        tlb_flush_region1(TLB_R_FORK);
+    }
+    return 0;
+}
+
+//======================================================================
+// Resolve a write to copy-on-write page vpn of pcb (the current process)
+// The last holder of a frame takes it over in place; otherwise the page
+// gets a private copy.
+// Returns 0 if the page is now writable, ERROR if it isn't COW or no
+// frame is available
+//======================================================================
+int vm_cow_fault(PCB *pcb, int vpn) {
+
+    if (vpn < 0 || vpn >= MAX_PT_LEN) {
+        return ERROR;
+    }
+
+    pte_t *pte = &pcb->region1_pt[vpn];
+    if (!pte->valid || !(pcb->vpages[vpn].flags & VPG_COW)) {
+        return ERROR;
+    }
+
+    // A merged or zero frame's use is the kernel's; the page's own is in
+    // its vpage
+    int old_pfn = pte->pfn;
+    frame_use_t use = frame_desc(old_pfn)->use;
+    if (use == FRAME_USER_MERGED || use == FRAME_ZERO_PAGE) {
+        use = pcb->vpages[vpn].use;
+    }
+    if (frame_refcount(old_pfn) > 1 && vm_reclaim(FRAME_CLASS_USER, 1) < 0) {
+        TracePrintf(0, "vm_cow_fault: pid %d out of memory\n", pcb->pid);
+        return ERROR;
+    }
+    // Reclaiming may have slept on the disk, and the other holders may
+    // have let go of the frame meanwhile
+    if (frame_refcount(old_pfn) > 1) {
+        int new_pfn;
+        if (old_pfn == frame_zero_page()) {
+            new_pfn = get_zeroed_frame();
+        } else {
+            new_pfn = get_free_frame();
+            copy_page_to_frame(vpn, new_pfn);
+        }
+        frame_tag(new_pfn, pcb->pid, use);
+        pte->pfn = new_pfn;
+        free_frame_number(old_pfn);
+    } else {
+        frame_tag(old_pfn, pcb->pid, use);
+    }
+
+    pte->prot |= PROT_WRITE;
+    pcb->vpages[vpn].flags &= ~VPG_COW;
+    if (pcb->vpages[vpn].flags & VPG_DMAP) {
+        pcb->vpages[vpn].flags |= VPG_DIRTY;
+    }
+    tlb_flush_page(VMEM_1_BASE + (vpn << PAGESHIFT), TLB_R_FAULT);
+    return 0;
+}
+
+//======================================================================
+// Make page vpn of pcb safe for the kernel to touch: bring it in if it
+// is not present yet, give it a private frame if it will be written, and
+// pin it until vm_unpin_all() at the end of the system call
+//======================================================================
+static int vm_touch(PCB *pcb, int vpn, int write) {
+    if (!pcb->region1_pt[vpn].valid && (pcb->vpages[vpn].flags & VPG_BACKED) &&
+        vm_page_fault(pcb, vpn) < 0) {
+        return ERROR;
+    }
+    if (write && (pcb->vpages[vpn].flags & VPG_COW) && vm_cow_fault(pcb, vpn) < 0) {
+        return ERROR;
+    }
+    // Keep it in memory until the system call is done with it
+    if (pcb->region1_pt[vpn].valid) {
+        pcb->vpages[vpn].flags |= VPG_PIN;
+    }
+    return 0;
+}
+
+static int vm_prepare_range(PCB *pcb, void *addr, int len, int write) {
+
+    unsigned int start = (unsigned int)addr;
+    unsigned int end   = start + len;
+
+    if (len <= 0 || start < VMEM_1_BASE || end > VMEM_1_LIMIT || end < start) {
+        return 0;
+    }
+
+    int first = (start - VMEM_1_BASE) >> PAGESHIFT;
+    int last  = (end - 1 - VMEM_1_BASE) >> PAGESHIFT;
+    for (int vpn = first; vpn <= last; vpn++) {
+        if (vm_touch(pcb, vpn, write) < 0) {
+            return ERROR;
+        }
+    }
+    return 0;
+}
+
+//======================================================================
+// Prepare [addr, addr + len) before the kernel reads or writes it on the
+// process's behalf: page it in and, for writes, break copy-on-write
+// Returns 0 on success, ERROR if a page can't be made usable
+//======================================================================
+int vm_prepare_user_read(PCB *pcb, void *addr, int len) {
+    return vm_prepare_range(pcb, addr, len, 0);
+}
+
+int vm_prepare_user_write(PCB *pcb, void *addr, int len) {
+    return vm_prepare_range(pcb, addr, len, 1);
+}
+
+//======================================================================
+// Same for a NUL-terminated string of unknown length, page by page
+//======================================================================
+int vm_prepare_user_string(PCB *pcb, char *str) {
+
+    unsigned int a = (unsigned int)str;
+
+    while (a >= VMEM_1_BASE && a < VMEM_1_LIMIT) {
+        int vpn = (a - VMEM_1_BASE) >> PAGESHIFT;
+        if (vm_touch(pcb, vpn, 0) < 0) {
+            return ERROR;
+        }
+        if (!pcb->region1_pt[vpn].valid) {
+            return 0;
+        }
+        unsigned int end = DOWN_TO_PAGE(a) + PAGESIZE;
+        if (memchr((void *)a, '\0', end - a) != NULL) {
+            return 0;
+        }
+        a = end;
+    }
+    return 0;
+}
+
+//======================================================================
+// Same for a NULL-terminated argument vector and its strings
+//======================================================================
+int vm_prepare_user_argv(PCB *pcb, char **argv) {
+
+    if (argv == NULL) {
+        return 0;
+    }
+    for (int i = 0; ; i++) {
+        if (vm_prepare_user_read(pcb, &argv[i], sizeof(char *)) < 0) {
+            return ERROR;
+        }
+        if (argv[i] == NULL) {
+            return 0;
+        }
+        if (vm_prepare_user_string(pcb, argv[i]) < 0) {
+            return ERROR;
+        }
+    }
+}
+
+//======================================================================
+// Release the pins taken while preparing a system call's buffers
+//======================================================================
+void vm_unpin_all(PCB *pcb) {
+    for (int vpn = 0; vpn < MAX_PT_LEN; vpn++) {
+        pcb->vpages[vpn].flags &= ~VPG_PIN;
+    }
+}
+
+//======================================================================
+// Forget the software state of pages [first, last), e.g. once unmapped,
+// giving back the swap slots of pages still on disk
+//======================================================================
+void vm_clear_range(PCB *pcb, int first, int last) {
+    for (int vpn = first; vpn < last; vpn++) {
+        if (pcb->vpages[vpn].flags & VPG_SWAP) {
+            swap_release(pcb->vpages[vpn].offset);
+        }
+    }
+    memset(&pcb->vpages[first], 0, (last - first) * sizeof(vpage_t));
+}
@@ -0,0 +1,66 @@
+/* vm.h - Region-1 virtual memory: copy-on-write sharing, demand paging and faults */
+
+#ifndef _VM_H
+#define _VM_H
+
+#include "hardware.h"
+#include "yalnix.h"
+#include "frame.h"
+#include "image.h"
+
+struct pcb;
+
+//==========================================================================
+// Per-page software state kept next to each region-1 page table entry
+//==========================================================================
+#define VPG_COW     0x01  /* frame is shared; the page is writable once private */
+#define VPG_FILE    0x02  /* not present; filled from the image on first touch */
+#define VPG_ZERO    0x04  /* not present; zero-filled on first touch */
+#define VPG_SHARED  0x08  /* shared memory segment; stays writable across Fork */
+#define VPG_SWAP    0x10  /* not present; contents in swap slot "offset" */
+#define VPG_REF     0x20  /* brought in since the swap clock last passed */
+#define VPG_PIN     0x40  /* in use by the current system call; not swapped */
+#define VPG_DISK    0x80  /* not present; read from the disk at byte "offset" */
+#define VPG_DMAP    0x100 /* part of a disk mapping; written back when dirty */
+#define VPG_DIRTY   0x200 /* disk-mapped page written since it was read */
+
+#define VPG_BACKED  (VPG_FILE | VPG_ZERO | VPG_SWAP | VPG_DISK)
+
+typedef struct vpage {
+    unsigned short flags;
+    unsigned char  prot;     /* protection once the page is present */
+    unsigned char  use;      /* frame_use_t of the frame it will get */
+    unsigned short nbytes;   /* bytes read from the image, the rest is zero */
+    unsigned int   offset;   /* offset of the page in the image or disk, or swap slot */
+} vpage_t;
+
+void vm_set_backing(struct pcb *pcb, int first, int last, int kind, int prot,
+                    frame_use_t use, unsigned int offset, unsigned int nbytes);
+int  vm_page_fault(struct pcb *pcb, int vpn);
+int  vm_reclaim(frame_class_t cls, int nframes);
+int  vm_find_gap(struct pcb *pcb, int npages, int stack_gap);
+
+//==========================================================================
+// Stack growth maps up to STACK_LOOKAHEAD spare pages below the faulting
+// one so deep recursion traps less often. Exec maps up front the stack
+// depth earlier runs of the same image reached, up to STACK_HINT_MAX.
+// Both are defaults; vm_set_stack_growth() changes them.
+//==========================================================================
+#define STACK_LOOKAHEAD  4
+#define STACK_HINT_MAX   16
+
+int  vm_grow_stack(struct pcb *pcb, int fault_vpn, int top_vpn, int floor_vpn);
+int  vm_stack_pages(struct pcb *pcb);
+int  vm_set_stack_growth(int lookahead, int hint_max);
+int  vm_stack_hint_max(void);
+
+int  vm_cow_clone(struct pcb *parent, struct pcb *child);
+int  vm_cow_fault(struct pcb *pcb, int vpn);
+int  vm_prepare_user_read(struct pcb *pcb, void *addr, int len);
+int  vm_prepare_user_write(struct pcb *pcb, void *addr, int len);
+int  vm_prepare_user_string(struct pcb *pcb, char *str);
+int  vm_prepare_user_argv(struct pcb *pcb, char **argv);
+void vm_unpin_all(struct pcb *pcb);
+void vm_clear_range(struct pcb *pcb, int first, int last);
+
+#endif /* _VM_H */
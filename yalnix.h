@@ -90,6 +90,27 @@
 #define YALNIX_CUSTOM_1         ( 0x71 | YALNIX_PREFIX)
 #define YALNIX_CUSTOM_2         ( 0x72 | YALNIX_PREFIX)
 
+// Spawn(filename, argv): Fork + Exec without copying the caller
+#define YALNIX_SPAWN            YALNIX_CUSTOM_0
+
+// Shared memory; regs[0] picks the operation:
+//   SHM_OP_CREATE(&id, npages) creates a segment and maps it
+//   SHM_OP_ATTACH(id) maps an existing one
+//   SHM_OP_DETACH(id) unmaps it from the caller
+#define YALNIX_SHM              YALNIX_CUSTOM_1
+#define SHM_OP_CREATE           0
+#define SHM_OP_ATTACH           1
+#define SHM_OP_DETACH           2
+
+// Disk mappings; regs[0] picks the operation:
+//   DISK_OP_MAP(sector, nsectors) maps disk sectors
+//   DISK_OP_UNMAP(addr) writes back and unmaps them
+//   DISK_OP_SWAPPED() counts the pages now out on swap
+#define YALNIX_DISK_MAP         YALNIX_CUSTOM_2
+#define DISK_OP_MAP             0
+#define DISK_OP_UNMAP           1
+#define DISK_OP_SWAPPED         2
+
 #define YALNIX_ABORT            ( 0xF0 | YALNIX_PREFIX)
 #define YALNIX_BOOT             ( 0xFF | YALNIX_PREFIX)
 